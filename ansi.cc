@@ -0,0 +1,239 @@
+#include "ansi.h"
+#include "render.h"
+#include "font.h"
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+using namespace CVD;
+
+namespace
+{
+	//Escape sequences to set each colour as the foreground, background
+	//or both.
+	struct Escapes
+	{
+		string fg[8], bg[8], both[8][8];
+
+		Escapes()
+		{
+			auto rgb = [](int i)
+			{
+				Rgb<byte> c = Renderer::colour(i);
+				return to_string(c.red) + ";" + to_string(c.green) + ";" + to_string(c.blue);
+			};
+
+			for(int f=0; f < 8; f++)
+			{
+				fg[f] = "\x1b[38;2;" + rgb(f) + "m";
+				bg[f] = "\x1b[48;2;" + rgb(f) + "m";
+				for(int b=0; b < 8; b++)
+					both[f][b] = "\x1b[38;2;" + rgb(f) + ";48;2;" + rgb(b) + "m";
+			}
+		}
+	};
+
+	const Escapes& escapes()
+	{
+		static const Escapes e;
+		return e;
+	}
+
+	const char reset[] = "\x1b[0m\n";
+
+	//Appends the UTF-8 for character c.
+	void utf8(unsigned int c, string& out)
+	{
+		if(c < 0x80)
+			out += char(c);
+		else if(c < 0x800)
+		{
+			out += char(0xc0 | (c >> 6));
+			out += char(0x80 | (c & 0x3f));
+		}
+		else if(c < 0x10000)
+		{
+			out += char(0xe0 | (c >> 12));
+			out += char(0x80 | ((c >> 6) & 0x3f));
+			out += char(0x80 | (c & 0x3f));
+		}
+		else
+		{
+			out += char(0xf0 | (c >> 18));
+			out += char(0x80 | ((c >> 12) & 0x3f));
+			out += char(0x80 | ((c >> 6) & 0x3f));
+			out += char(0x80 | (c & 0x3f));
+		}
+	}
+
+	//Teletext characters which aren't the same as in ASCII (the UK set).
+	unsigned int text_char(int c)
+	{
+		switch(c)
+		{
+			case 0x23: return 0xa3;   //£
+			case 0x5b: return 0x2190; //←
+			case 0x5c: return 0xbd;   //½
+			case 0x5d: return 0x2192; //→
+			case 0x5e: return 0x2191; //↑
+			case 0x5f: return '#';
+			case 0x60: return 0x2015; //―
+			case 0x7b: return 0xbc;   //¼
+			case 0x7c: return 0x2016; //‖
+			case 0x7d: return 0xbe;   //¾
+			case 0x7e: return 0xf7;   //÷
+			case 0x7f: return 0x25a0; //■
+			default: return c;
+		}
+	}
+
+	//Sixels as bits, top left in bit 0 to bottom right in bit 5, which
+	//is the order Unicode puts the sextants in. Empty, full, left and
+	//right halves aren't sextants, since they already exist.
+	unsigned int sextant(int s)
+	{
+		if(s == 0)
+			return ' ';
+		else if(s == 21)
+			return 0x258c; //▌
+		else if(s == 42)
+			return 0x2590; //▐
+		else if(s == 63)
+			return 0x2588; //█
+		else
+			return 0x1fb00 + s - 1 - (s > 21) - (s > 42);
+	}
+
+	//The characters for each glyph, mode and height, worked out once.
+	struct Glyphs
+	{
+		char chars[128][3][3][5];
+
+		Glyphs()
+		{
+			for(int c=0; c < 128; c++)
+				for(int m=0; m < 3; m++)
+					for(int h=0; h < 3; h++)
+					{
+						string s;
+						utf8_glyph(c, FontSet::Mode(m), FontSet::Height(h), s);
+						strcpy(chars[c][m][h], s.c_str());
+					}
+		}
+
+		static void utf8_glyph(int c, FontSet::Mode m, FontSet::Height h, string& out)
+		{
+			if(c < 32)
+				out += ' ';
+			else if(m != FontSet::Normal && (c & 32))
+			{
+				//Graphics codes put bit 6 where the last sixel goes.
+				int s = (c & 31) | ((c & 64) >> 1);
+				int rows[3] = {s & 3, (s >> 2) & 3, (s >> 4) & 3};
+
+				//Double height stretches three rows of sixels over six.
+				if(h == FontSet::Upper)
+					s = rows[0] | rows[0] << 2 | rows[1] << 4;
+				else if(h == FontSet::Lower)
+					s = rows[1] | rows[2] << 2 | rows[2] << 4;
+
+				utf8(sextant(s), out);
+			}
+			else if(h == FontSet::Lower)
+				out += ' '; //Text only goes on the top row
+			else
+				utf8(text_char(c), out);
+		}
+	};
+
+	const Glyphs& glyphs()
+	{
+		static const Glyphs g;
+		return g;
+	}
+}
+
+void ansi_cells(const PageCells& cells, bool flash_on, string& out)
+{
+	const Escapes& e = escapes();
+	const Glyphs& g = glyphs();
+
+	for(int y=0; y < PageCells::h; y++)
+	{
+		int fg=-1, bg=-1;
+
+		for(int x=0; x < PageCells::w; x++)
+		{
+			const Cell& c = cells[y][x];
+			const char* s = " ";
+			if(!c.hidden && !(c.flash && !flash_on))
+				s = g.chars[c.glyph][c.mode][c.height];
+
+			//Spaces don't care about the foreground.
+			bool blank = s[0] == ' ' && s[1] == 0;
+
+			if(c.bg != bg && !blank && c.fg != fg)
+				out += e.both[c.fg][c.bg];
+			else if(c.bg != bg)
+				out += e.bg[c.bg];
+			else if(!blank && c.fg != fg)
+				out += e.fg[c.fg];
+
+			bg = c.bg;
+			if(!blank)
+				fg = c.fg;
+
+			out += s;
+		}
+
+		out += reset;
+	}
+}
+
+void ansi_halfblocks(const BasicImage<byte>& colours, int cols, string& out)
+{
+	const Escapes& e = escapes();
+	const ImageRef size = colours.size();
+
+	//Terminal characters are about twice as tall as they are wide, so
+	//half blocks are roughly square.
+	const int pixel_rows = (size.y * cols + size.x/2) / size.x;
+	const int rows = (pixel_rows + 1) / 2;
+
+	for(int r=0; r < rows; r++)
+	{
+		//Sample the middle of each pixel.
+		const byte* top = colours[(4*r + 1) * size.y / (2*pixel_rows)];
+		const byte* bottom = colours[(min(2*r+1, pixel_rows-1)*2 + 1) * size.y / (2*pixel_rows)];
+		int fg=-1, bg=-1;
+
+		for(int x=0; x < cols; x++)
+		{
+			int sx = (2*x + 1) * size.x / (2*cols);
+			int t = top[sx] & 7;
+			int b = bottom[sx] & 7;
+
+			if(t == b)
+			{
+				if(b != bg)
+					out += e.bg[b];
+				bg = b;
+				out += ' ';
+				continue;
+			}
+
+			if(t != fg && b != bg)
+				out += e.both[t][b];
+			else if(t != fg)
+				out += e.fg[t];
+			else if(b != bg)
+				out += e.bg[b];
+			fg = t;
+			bg = b;
+
+			out += "\xe2\x96\x80"; //Upper half block
+		}
+
+		out += reset;
+	}
+}
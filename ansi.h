@@ -0,0 +1,25 @@
+#ifndef ANSI_H_m5Rj2QwYc8TbLz
+#define ANSI_H_m5Rj2QwYc8TbLz
+#include <string>
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include "cells.h"
+
+//Pages as ANSI truecolour text, for looking at pages in a terminal
+//without a display. Colours are only set where they change along a row,
+//and each row ends by resetting them, so output can be written to the
+//terminal in one go.
+
+//One character per cell. Text is UTF-8 (with the UK teletext
+//characters such as £ in their places) and graphics are Unicode
+//sextants, which have the same 2x3 layout as sixels. Double height
+//graphics are stretched over both rows. Separated graphics are drawn
+//contiguous, since terminals have no way of showing them.
+void ansi_cells(const PageCells& cells, bool flash_on, std::string& out);
+
+//A rendered page, as colour numbers (see PixelFormat::Index8), scaled
+//to cols characters across. Each character is an upper half block, so
+//it shows two pixels, one above the other.
+void ansi_halfblocks(const CVD::BasicImage<CVD::byte>& colours, int cols, std::string& out);
+
+#endif
@@ -0,0 +1,431 @@
+#include "archive.h"
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace CVD;
+
+static const char archive_magic[8] = {'T','T','X','A','R','C','H','1'};
+
+static string error_text(const string& what, const string& name)
+{
+	return what + " \"" + name + "\": " + strerror(errno);
+}
+
+static void write_all(int fd, const void* data, size_t n, off_t offset, const string& name)
+{
+	const char* p = static_cast<const char*>(data);
+	while(n > 0)
+	{
+		ssize_t w = pwrite(fd, p, n, offset);
+		if(w < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw ArchiveError(error_text("Error writing to", name));
+		}
+		p += w;
+		n -= w;
+		offset += w;
+	}
+}
+
+static void sync_file(int fd, const string& name)
+{
+	if(fsync(fd) != 0)
+		throw ArchiveError(error_text("Error writing to", name));
+}
+
+//A rename is only durable once the directory is synced.
+static void sync_directory(const string& name)
+{
+	size_t slash = name.rfind('/');
+	string dir = slash == string::npos ? "." : slash == 0 ? "/" : name.substr(0, slash);
+
+	int fd = open(dir.c_str(), O_RDONLY);
+	if(fd == -1)
+		return;
+	fsync(fd);
+	close(fd);
+}
+
+static bool entry_less(const PageArchive::Entry& a, const PageArchive::Entry& b)
+{
+	return make_pair(a.page, a.subpage) < make_pair(b.page, b.subpage);
+}
+
+static PageArchive::Entry make_entry(int page, int subpage, const string& name, uint32_t record, const BasicImage<byte>& text)
+{
+	PageArchive::Entry e;
+	memset(&e, 0, sizeof(e));
+	e.page = page;
+	e.subpage = subpage;
+	e.record = record;
+	e.hash = PageArchive::hash(text);
+	strncpy(e.name, name.c_str(), sizeof(e.name)-1);
+	return e;
+}
+
+//records can be more than count if some records are no longer in the index.
+static PageArchive::Header make_header(uint64_t count, uint64_t records)
+{
+	PageArchive::Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, archive_magic, sizeof(h.magic));
+	h.page_bytes = PageArchive::page_bytes;
+	h.entry_bytes = sizeof(PageArchive::Entry);
+	h.count = count;
+	h.records_offset = sizeof(PageArchive::Header);
+	h.index_offset = h.records_offset + records * PageArchive::page_bytes;
+	return h;
+}
+
+static void check_page(const BasicImage<byte>& text)
+{
+	if(text.size().area() != PageArchive::page_bytes || text.row_stride() != text.size().x)
+		throw ArchiveError("Archive pages must be 40x25");
+}
+
+//FNV-1a
+uint64_t PageArchive::hash(const BasicImage<byte>& text)
+{
+	uint64_t h = 14695981039346656037ull;
+	for(int y=0; y < text.size().y; y++)
+		for(int x=0; x < text.size().x; x++)
+		{
+			h ^= text[y][x];
+			h *= 1099511628211ull;
+		}
+	return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Reading and in place updates
+//
+
+PageArchive::PageArchive(const string& name, bool w)
+:writable(w),
+ filename(name)
+{
+	fd = open(name.c_str(), writable ? O_RDWR : O_RDONLY);
+	if(fd < 0)
+		throw ArchiveError(error_text("Error opening", name));
+
+	try
+	{
+		map_file();
+	}
+	catch(...)
+	{
+		close(fd);
+		throw;
+	}
+}
+
+PageArchive::~PageArchive()
+{
+	unmap_file();
+	close(fd);
+}
+
+void PageArchive::map_file()
+{
+	struct stat s;
+	if(fstat(fd, &s) != 0)
+		throw ArchiveError(error_text("Error reading", filename));
+
+	if(static_cast<size_t>(s.st_size) < sizeof(Header))
+		throw ArchiveError("\"" + filename + "\" is not a page archive");
+
+	map_size = s.st_size;
+	void* m = mmap(nullptr, map_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+	if(m == MAP_FAILED)
+	{
+		map = nullptr;
+		throw ArchiveError(error_text("Error mapping", filename));
+	}
+	map = static_cast<byte*>(m);
+
+	//Everything here comes from the file, so it's checked in a way which
+	//can't overflow, and so that no entry points outside the records.
+	const Header& h = header();
+	bool ok = memcmp(h.magic, archive_magic, sizeof(h.magic)) == 0 && h.page_bytes == page_bytes && h.entry_bytes == sizeof(Entry)
+	          && h.records_offset >= sizeof(Header) && h.records_offset <= h.index_offset && h.index_offset <= map_size
+	          && h.count <= (map_size - h.index_offset) / sizeof(Entry);
+
+	const uint64_t records = ok ? (h.index_offset - h.records_offset) / page_bytes : 0;
+	for(uint64_t i=0; ok && i < h.count; i++)
+		ok = index()[i].record < records;
+
+	if(!ok)
+	{
+		unmap_file();
+		throw ArchiveError("\"" + filename + "\" is not a page archive or is damaged");
+	}
+}
+
+void PageArchive::unmap_file()
+{
+	if(map)
+		munmap(map, map_size);
+	map = nullptr;
+}
+
+void PageArchive::create(const string& name)
+{
+	ArchiveWriter w(name);
+	w.finish();
+}
+
+string PageArchive::name(size_t i) const
+{
+	const Entry& e = entry(i);
+	return string(e.name, strnlen(e.name, sizeof(e.name)));
+}
+
+BasicImage<byte> PageArchive::page(size_t i) const
+{
+	return BasicImage<byte>(map + header().records_offset + entry(i).record * size_t(page_bytes), ImageRef(40, 25));
+}
+
+long PageArchive::find(int page, int subpage) const
+{
+	Entry key;
+	key.page = page;
+	key.subpage = subpage;
+
+	const Entry* b = index();
+	const Entry* e = b + size();
+	const Entry* i = lower_bound(b, e, key, entry_less);
+
+	if(i == e || i->page != page || i->subpage != subpage)
+		return -1;
+	return i - b;
+}
+
+void PageArchive::write(size_t i, const BasicImage<byte>& text)
+{
+	if(!writable)
+		throw ArchiveError("\"" + filename + "\" is open read only");
+	check_page(text);
+
+	vector<Entry> entries(index(), index() + size());
+	entries[i] = make_entry(entries[i].page, entries[i].subpage, name(i), 0, text);
+	append(entries, i, text);
+}
+
+size_t PageArchive::add(int page, int subpage, const string& name, const BasicImage<byte>& text)
+{
+	long existing = find(page, subpage);
+	if(existing >= 0)
+	{
+		write(existing, text);
+		return existing;
+	}
+
+	if(!writable)
+		throw ArchiveError("\"" + filename + "\" is open read only");
+	check_page(text);
+
+	vector<Entry> entries(index(), index() + size());
+	Entry e = make_entry(page, subpage, name, 0, text);
+	auto pos = entries.insert(upper_bound(entries.begin(), entries.end(), e, entry_less), e);
+	size_t i = pos - entries.begin();
+	append(entries, i, text);
+	return i;
+}
+
+//Nothing live is ever overwritten. The new record goes in the first
+//whole record after the end of the current index, followed by the new
+//index. Those are synced to disk before the header is changed to point
+//at them (and synced again), so if something goes wrong part way, the
+//header still describes the old contents. The old index (and the old
+//record of a replaced page) is left behind unreferenced, so once there's
+//more of that than there are live pages and index, the archive is
+//compacted.
+void PageArchive::append(vector<Entry>& entries, size_t i, const BasicImage<byte>& text)
+{
+	const Header old = header();
+	const uint64_t end = old.index_offset + old.count * sizeof(Entry);
+	const uint64_t record = (end - old.records_offset + page_bytes - 1) / page_bytes;
+	entries[i].record = record;
+
+	const Header h = make_header(entries.size(), record + 1);
+	write_all(fd, text.data(), page_bytes, h.records_offset + record * page_bytes, filename);
+	write_all(fd, entries.data(), entries.size() * sizeof(Entry), h.index_offset, filename);
+	sync_file(fd, filename);
+	write_all(fd, &h, sizeof(h), 0, filename);
+	sync_file(fd, filename);
+
+	unmap_file();
+	map_file();
+
+	const uint64_t live = size() * (page_bytes + sizeof(Entry));
+	if(map_size > sizeof(Header) + 2 * live)
+	{
+		//The page is safely saved either way, so if this fails it's
+		//simply tried again next time.
+		try
+		{
+			compact();
+		}
+		catch(ArchiveError&)
+		{}
+	}
+}
+
+//The live pages are copied to a new archive beside this one, which is
+//synced and renamed over it, so a crash leaves one or the other. Anyone
+//else with the archive open carries on reading the old copy.
+void PageArchive::compact()
+{
+	const string tmp = filename + "." + to_string(getpid()) + ".tmp";
+
+	try
+	{
+		ArchiveWriter w(tmp);
+		for(size_t i=0; i < size(); i++)
+			w.add(entry(i).page, entry(i).subpage, name(i), page(i));
+		w.finish();
+
+		int t = open(tmp.c_str(), O_RDWR);
+		if(t < 0)
+			throw ArchiveError(error_text("Error opening", tmp));
+
+		struct stat s;
+		if(fstat(fd, &s) == 0)
+			fchmod(t, s.st_mode & 07777);
+
+		bool synced = fsync(t) == 0;
+		close(t);
+		if(!synced)
+			throw ArchiveError(error_text("Error writing to", tmp));
+
+		if(rename(tmp.c_str(), filename.c_str()) != 0)
+			throw ArchiveError(error_text("Error replacing", filename));
+	}
+	catch(...)
+	{
+		unlink(tmp.c_str());
+		throw;
+	}
+
+	sync_directory(filename);
+
+	int new_fd = open(filename.c_str(), O_RDWR);
+	if(new_fd < 0)
+		throw ArchiveError(error_text("Error opening", filename));
+
+	unmap_file();
+	close(fd);
+	fd = new_fd;
+	map_file();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Writing new archives
+//
+
+ArchiveWriter::ArchiveWriter(const string& name)
+:filename(name)
+{
+	fd = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if(fd < 0)
+		throw ArchiveError(error_text("Error creating", name));
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+	if(fd >= 0)
+		close(fd);
+}
+
+void ArchiveWriter::add(int page, int subpage, const string& name, const BasicImage<byte>& text)
+{
+	check_page(text);
+
+	const PageArchive::Header h = make_header(entries.size(), entries.size());
+	write_all(fd, text.data(), PageArchive::page_bytes, h.index_offset, filename);
+	entries.push_back(make_entry(page, subpage, name, entries.size(), text));
+}
+
+void ArchiveWriter::finish()
+{
+	//Records for replaced pages are left in the file, unreferenced.
+	const uint64_t records = entries.size();
+
+	stable_sort(entries.begin(), entries.end(), entry_less);
+
+	//Later pages with the same number replace earlier ones.
+	auto same = [](const PageArchive::Entry& a, const PageArchive::Entry& b)
+	{
+		return a.page == b.page && a.subpage == b.subpage;
+	};
+	auto last = entries.begin();
+	for(auto i=entries.begin(); i != entries.end(); ++i)
+	{
+		if(last != entries.begin() && same(*(last-1), *i))
+			*(last-1) = *i;
+		else
+			*last++ = *i;
+	}
+	entries.erase(last, entries.end());
+
+	PageArchive::Header h = make_header(entries.size(), records);
+
+	write_all(fd, entries.data(), entries.size() * sizeof(PageArchive::Entry), h.index_offset, filename);
+	write_all(fd, &h, sizeof(h), 0, filename);
+
+	if(close(fd) != 0)
+	{
+		fd = -1;
+		throw ArchiveError(error_text("Error writing to", filename));
+	}
+	fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Naming pages in archives
+//
+
+bool parse_archive_name(const string& name, string& file, int& page, int& subpage)
+{
+	const string ext = ".ttxa";
+	size_t e = name.rfind(ext);
+	if(e == string::npos)
+		return false;
+
+	size_t end = e + ext.size();
+	if(end != name.size() && name[end] != ':')
+		return false;
+
+	file = name.substr(0, end);
+	page = subpage = -1;
+
+	if(end == name.size())
+		return true;
+
+	istringstream in(name.substr(end+1));
+	in >> hex >> page;
+	if(in.get() == '/')
+		in >> hex >> subpage;
+
+	return true;
+}
+
+string archive_name(const string& file, int page, int subpage)
+{
+	ostringstream o;
+	o << file << ":" << hex << page << "/" << subpage;
+	return o.str();
+}
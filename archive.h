@@ -0,0 +1,146 @@
+#ifndef ARCHIVE_H_Gd7sYq3mVw8KcP
+#define ARCHIVE_H_Gd7sYq3mVw8KcP
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+//A file holding many pages, read in place through mmap.
+//
+//Layout (native byte order):
+//
+//  Header    64 bytes
+//  Records   count pages of 40x25 bytes, back to back
+//  Index     count Entries, sorted by page and subpage
+//
+//The index is at the end so that pages can be streamed into a new
+//archive and the index written once at the end. Opening an archive
+//only maps it and checks the header and index; the pages themselves
+//aren't read until they're asked for.
+
+struct ArchiveError: public std::runtime_error
+{
+	using std::runtime_error::runtime_error;
+};
+
+class PageArchive
+{
+	public:
+
+	static const int page_bytes = 40*25;
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t page_bytes;
+		uint32_t entry_bytes;
+		uint64_t count;
+		uint64_t records_offset;
+		uint64_t index_offset;
+		char reserved[24];
+	};
+
+	struct Entry
+	{
+		uint16_t page;
+		uint16_t subpage;
+		uint32_t record;
+		uint64_t hash;
+		char name[48];
+	};
+
+	static uint64_t hash(const CVD::BasicImage<CVD::byte>& text);
+
+	private:
+
+	int fd=-1;
+	bool writable;
+	CVD::byte* map=nullptr;
+	size_t map_size=0;
+	std::string filename;
+
+	const Header& header() const
+	{
+		return *reinterpret_cast<const Header*>(map);
+	}
+
+	Entry* index() const
+	{
+		return reinterpret_cast<Entry*>(map + header().index_offset);
+	}
+
+	void map_file();
+	void unmap_file();
+	void append(std::vector<Entry>& entries, size_t i, const CVD::BasicImage<CVD::byte>& text);
+	void compact();
+
+	public:
+
+	//Opens an existing archive. Throws ArchiveError on failure.
+	PageArchive(const std::string& name, bool writable=false);
+	~PageArchive();
+
+	PageArchive(const PageArchive&) = delete;
+	PageArchive& operator=(const PageArchive&) = delete;
+
+	//Make a new, empty archive, replacing any existing file.
+	static void create(const std::string& name);
+
+	size_t size() const
+	{
+		return header().count;
+	}
+
+	//Entries are in page/subpage order.
+	const Entry& entry(size_t i) const
+	{
+		return index()[i];
+	}
+
+	std::string name(size_t i) const;
+
+	//The page, straight out of the mapped file. Don't write to it.
+	CVD::BasicImage<CVD::byte> page(size_t i) const;
+
+	//Index of the entry, or -1 if it isn't there.
+	long find(int page, int subpage) const;
+
+	//Replace a page. Like add(), the new page is written beside the old
+	//one, so the old one is kept if anything goes wrong. Space left by old
+	//copies is reclaimed by rewriting the archive once it's more than half
+	//of the file. The archive must be writable.
+	void write(size_t i, const CVD::BasicImage<CVD::byte>& text);
+
+	//Add a page (or replace it, if it's already there). Returns the index
+	//of its entry. The archive must be writable.
+	size_t add(int page, int subpage, const std::string& name, const CVD::BasicImage<CVD::byte>& text);
+};
+
+//Writes a new archive a page at a time. Only the index is held in
+//memory, and it's written out by finish().
+class ArchiveWriter
+{
+	int fd;
+	std::string filename;
+	std::vector<PageArchive::Entry> entries;
+
+	public:
+
+	ArchiveWriter(const std::string& name);
+	~ArchiveWriter();
+
+	void add(int page, int subpage, const std::string& name, const CVD::BasicImage<CVD::byte>& text);
+	void finish();
+};
+
+//Archive pages are named as file.ttxa:page/subpage, with the page and
+//subpage in hex as they are on air (e.g. pages.ttxa:1a0/3). The page
+//and subpage are optional. Returns false if the name isn't in an
+//archive; otherwise page and subpage are set, or -1 if not given.
+bool parse_archive_name(const std::string& name, std::string& file, int& page, int& subpage);
+
+std::string archive_name(const std::string& file, int page, int subpage);
+
+#endif
@@ -0,0 +1,280 @@
+#include "blit.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define BLIT_X86
+	#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace CVD;
+
+//A row is 12 pixels, i.e. 36 bytes. The SIMD kernels build a byte mask
+//for the row (0xff where the pixel is set) and then blend:
+//
+//  out = bg ^ ((fg^bg) & mask)
+//
+//The colours are laid out as repeating RGB patterns, 48 bytes long so
+//that any of the 16 byte chunks of a row can be loaded from them.
+
+static void fill_pattern(byte* p, Rgb<byte> c)
+{
+	for(int i=0; i < 48; i+=3)
+	{
+		p[i+0] = c.red;
+		p[i+1] = c.green;
+		p[i+2] = c.blue;
+	}
+}
+
+static void blit_scalar(Rgb<byte>* out, int stride, const uint16_t* rows, int n, Rgb<byte> fg, Rgb<byte> bg)
+{
+	for(int r=0; r < n; r++, out += stride)
+	{
+		uint16_t bits = rows[r];
+		for(int i=0; i < 12; i++, bits>>=1)
+			out[i] = (bits&1) ? fg : bg;
+	}
+}
+
+#ifdef BLIT_X86
+
+//Byte g of the row belongs to pixel g/3. Each chunk of the row covers at
+//most 8 pixels, so the row bits are shifted down to the first pixel of
+//the chunk and broadcast to every byte. The selector picks out the bit
+//for the pixel each byte belongs to.
+//
+//  bytes  0-15: pixels 0-5,   shift 0
+//  bytes 16-31: pixels 5-10,  shift 5
+//  bytes 32-35: pixels 10-11, shift 10
+alignas(16) static const byte sse_select[3][16] =
+{
+	{1,1,1, 2,2,2, 4,4,4, 8,8,8, 16,16,16, 32},
+	{1,1, 2,2,2, 4,4,4, 8,8,8, 16,16,16, 32,32},
+	{1, 2,2,2, 0,0,0,0,0,0,0,0,0,0,0,0},
+};
+
+__attribute__((target("sse2")))
+static void blit_sse2(Rgb<byte>* out, int stride, const uint16_t* rows, int n, Rgb<byte> fg, Rgb<byte> bg)
+{
+	byte fgp[48], bgp[48];
+	fill_pattern(fgp, fg);
+	fill_pattern(bgp, bg);
+
+	__m128i b[3], x[3], sel[3];
+	for(int i=0; i < 3; i++)
+	{
+		b[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgp + 16*i));
+		x[i] = _mm_xor_si128(b[i], _mm_loadu_si128(reinterpret_cast<const __m128i*>(fgp + 16*i)));
+		sel[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(sse_select[i]));
+	}
+
+	for(int r=0; r < n; r++, out += stride)
+	{
+		byte* o = reinterpret_cast<byte*>(out);
+		const int bits = rows[r];
+
+		__m128i m0 = _mm_and_si128(_mm_set1_epi8(static_cast<char>(bits)), sel[0]);
+		__m128i m1 = _mm_and_si128(_mm_set1_epi8(static_cast<char>(bits >> 5)), sel[1]);
+		__m128i m2 = _mm_and_si128(_mm_set1_epi8(static_cast<char>(bits >> 10)), sel[2]);
+		m0 = _mm_cmpeq_epi8(m0, sel[0]);
+		m1 = _mm_cmpeq_epi8(m1, sel[1]);
+		m2 = _mm_cmpeq_epi8(m2, sel[2]);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm_xor_si128(b[0], _mm_and_si128(x[0], m0)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(o+16), _mm_xor_si128(b[1], _mm_and_si128(x[1], m1)));
+
+		//Only 4 bytes of the last chunk are in the row.
+		int tail = _mm_cvtsi128_si32(_mm_xor_si128(b[2], _mm_and_si128(x[2], m2)));
+		memcpy(o+32, &tail, 4);
+	}
+}
+
+//The AVX2 kernel does bytes 0-31 (pixels 0-10) in one go. The row is
+//broadcast as 16 bit words, and the shuffle picks out the low or high
+//byte depending on whether the pixel is below 8.
+alignas(32) static const byte avx_shuffle[32] =
+{
+	0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,
+	0,0, 0,0,0, 0,0,0, 1,1,1, 1,1,1, 1,1,
+};
+
+alignas(32) static const byte avx_select[32] =
+{
+	1,1,1, 2,2,2, 4,4,4, 8,8,8, 16,16,16, 32,
+	32,32, 64,64,64, 128,128,128, 1,1,1, 2,2,2, 4,4,
+};
+
+__attribute__((target("avx2")))
+static void blit_avx2(Rgb<byte>* out, int stride, const uint16_t* rows, int n, Rgb<byte> fg, Rgb<byte> bg)
+{
+	byte fgp[48], bgp[48];
+	fill_pattern(fgp, fg);
+	fill_pattern(bgp, bg);
+
+	const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bgp));
+	const __m256i x = _mm256_xor_si256(b, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fgp)));
+	const __m256i shuf = _mm256_load_si256(reinterpret_cast<const __m256i*>(avx_shuffle));
+	const __m256i sel = _mm256_load_si256(reinterpret_cast<const __m256i*>(avx_select));
+
+	const __m128i bt = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgp+32));
+	const __m128i xt = _mm_xor_si128(bt, _mm_loadu_si128(reinterpret_cast<const __m128i*>(fgp+32)));
+	const __m128i selt = _mm_load_si128(reinterpret_cast<const __m128i*>(sse_select[2]));
+
+	for(int r=0; r < n; r++, out += stride)
+	{
+		byte* o = reinterpret_cast<byte*>(out);
+		const int bits = rows[r];
+
+		__m256i m = _mm256_shuffle_epi8(_mm256_set1_epi16(static_cast<short>(bits)), shuf);
+		m = _mm256_cmpeq_epi8(_mm256_and_si256(m, sel), sel);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(o), _mm256_xor_si256(b, _mm256_and_si256(x, m)));
+
+		__m128i mt = _mm_and_si128(_mm_set1_epi8(static_cast<char>(bits >> 10)), selt);
+		mt = _mm_cmpeq_epi8(mt, selt);
+		int tail = _mm_cvtsi128_si32(_mm_xor_si128(bt, _mm_and_si128(xt, mt)));
+		memcpy(o+32, &tail, 4);
+	}
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Other pixel formats
+//
+
+namespace
+{
+	//Masks for groups of pixels: all ones for each set pixel of 4 as 8 bit
+	//indices or RGBA, or 0xf in the right nibble for each set pixel of 6
+	//as 4 bit indices.
+	struct Masks
+	{
+		byte index8[16][4];
+		uint64_t index4[2][64];
+		uint32_t rgba[16][4];
+
+		Masks()
+		{
+			for(int i=0; i < 16; i++)
+				for(int b=0; b < 4; b++)
+				{
+					index8[i][b] = (i>>b)&1 ? 0xff : 0;
+					rgba[i][b] = (i>>b)&1 ? 0xffffffff : 0;
+				}
+
+			//The masks for the left and right 6 pixels go in bytes 0-2 and
+			//3-5, so that the two can just be ORed together.
+			for(int h=0; h < 2; h++)
+				for(int i=0; i < 64; i++)
+				{
+					byte m[8] = {0};
+					for(int b=0; b < 3; b++)
+						m[3*h+b] = ((i>>(2*b))&1 ? 0xf0 : 0) | ((i>>(2*b+1))&1 ? 0x0f : 0);
+					memcpy(&index4[h][i], m, 8);
+				}
+		}
+	};
+
+	const Masks masks;
+}
+
+void blit_index8(byte* out, int stride, const uint16_t* rows, int n, byte fg, byte bg)
+{
+	uint32_t f, b;
+	memset(&f, fg, 4);
+	memset(&b, bg, 4);
+	const uint32_t x = f ^ b;
+
+	for(int r=0; r < n; r++, out += stride)
+		for(int i=0; i < 3; i++)
+		{
+			uint32_t m;
+			memcpy(&m, masks.index8[(rows[r] >> (4*i)) & 15], 4);
+			m = b ^ (x & m);
+			memcpy(out + 4*i, &m, 4);
+		}
+}
+
+void blit_index4(byte* out, int stride, const uint16_t* rows, int n, byte fg, byte bg)
+{
+	uint64_t f, b;
+	memset(&f, fg * 0x11, 8);
+	memset(&b, bg * 0x11, 8);
+	const uint64_t x = f ^ b;
+
+	//The row is 6 bytes, so it's done as 8 and only 6 are stored.
+	for(int r=0; r < n; r++, out += stride)
+	{
+		uint64_t m = masks.index4[0][rows[r] & 63] | masks.index4[1][(rows[r] >> 6) & 63];
+		m = b ^ (x & m);
+		memcpy(out, &m, 6);
+	}
+}
+
+void blit_rgba(Rgba<byte>* out, int stride, const uint16_t* rows, int n, Rgba<byte> fg, Rgba<byte> bg)
+{
+	uint32_t f, b;
+	memcpy(&f, &fg, 4);
+	memcpy(&b, &bg, 4);
+	const uint32_t x = f ^ b;
+
+	for(int r=0; r < n; r++, out += stride)
+	{
+		uint32_t o[12];
+		for(int i=0; i < 3; i++)
+		{
+			const uint32_t* m = masks.rgba[(rows[r] >> (4*i)) & 15];
+			for(int j=0; j < 4; j++)
+				o[4*i+j] = b ^ (x & m[j]);
+		}
+		memcpy(out, o, sizeof(o));
+	}
+}
+
+bool blit_kernel_available(BlitKernel k)
+{
+	if(k == BlitKernel::Scalar)
+		return true;
+
+	#ifdef BLIT_X86
+		__builtin_cpu_init();
+		if(k == BlitKernel::SSE2)
+			return __builtin_cpu_supports("sse2");
+		if(k == BlitKernel::AVX2)
+			return __builtin_cpu_supports("avx2");
+	#endif
+
+	return false;
+}
+
+BlitKernel best_blit_kernel()
+{
+	if(blit_kernel_available(BlitKernel::AVX2))
+		return BlitKernel::AVX2;
+	if(blit_kernel_available(BlitKernel::SSE2))
+		return BlitKernel::SSE2;
+	return BlitKernel::Scalar;
+}
+
+BlitFunction get_blit_function(BlitKernel k)
+{
+	#ifdef BLIT_X86
+		if(k == BlitKernel::SSE2)
+			return blit_sse2;
+		if(k == BlitKernel::AVX2)
+			return blit_avx2;
+	#endif
+
+	return blit_scalar;
+}
+
+const char* blit_kernel_name(BlitKernel k)
+{
+	if(k == BlitKernel::SSE2)
+		return "sse2";
+	if(k == BlitKernel::AVX2)
+		return "avx2";
+	return "scalar";
+}
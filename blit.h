@@ -0,0 +1,41 @@
+#ifndef BLIT_H_Vn8cTq2yLk5eHs
+#define BLIT_H_Vn8cTq2yLk5eHs
+#include <cvd/rgb.h>
+#include <cvd/rgba.h>
+#include <cvd/byte.h>
+#include <cstdint>
+
+//Kernels which expand glyph rows (12 pixel bitmasks, leftmost pixel in
+//bit 0) into RGB pixels: set bits become fg and clear bits become bg.
+//All kernels produce identical output, the only difference is speed.
+
+enum class BlitKernel
+{
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+//Draw n rows of 12 pixels. stride is in pixels.
+typedef void (*BlitFunction)(CVD::Rgb<CVD::byte>* out, int stride, const uint16_t* rows, int n, CVD::Rgb<CVD::byte> fg, CVD::Rgb<CVD::byte> bg);
+
+//The fastest kernel this CPU supports.
+BlitKernel best_blit_kernel();
+
+//Whether the kernel is compiled in and supported by the CPU.
+bool blit_kernel_available(BlitKernel k);
+
+BlitFunction get_blit_function(BlitKernel k);
+
+const char* blit_kernel_name(BlitKernel k);
+
+//The same for the other pixel formats, with colours as palette indices.
+//These are plain C++, but table driven, and write a third of the bytes
+//(or less) that RGB does. stride is in bytes, or pixels for RGBA. 4 bit
+//pixels are packed two to a byte, left one in the high nibble, so a row
+//of 12 is 6 whole bytes.
+void blit_index8(CVD::byte* out, int stride, const uint16_t* rows, int n, CVD::byte fg, CVD::byte bg);
+void blit_index4(CVD::byte* out, int stride, const uint16_t* rows, int n, CVD::byte fg, CVD::byte bg);
+void blit_rgba(CVD::Rgba<CVD::byte>* out, int stride, const uint16_t* rows, int n, CVD::Rgba<CVD::byte> fg, CVD::Rgba<CVD::byte> bg);
+
+#endif
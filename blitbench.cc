@@ -0,0 +1,103 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include <cvd/image.h>
+
+#include "render.h"
+
+using namespace std;
+using namespace CVD;
+
+//Checks that every blit kernel renders identically to the scalar one,
+//then reports how many cells per second each of them manages.
+
+vector<Image<byte>> load_pages(int argc, char** argv)
+{
+	vector<Image<byte>> pages;
+
+	for(int i=1; i < argc; i++)
+	{
+		ifstream in(argv[i]);
+		Image<byte> text(ImageRef(Renderer::w, Renderer::h));
+		in.read(reinterpret_cast<char*>(text.data()), text.size().area());
+
+		if(in.good())
+			pages.push_back(text);
+		else
+			cerr << "Error reading from \"" << argv[i] << "\"\n";
+	}
+
+	//Random pages hit every control code, colour and glyph.
+	mt19937 rng(0);
+	for(int i=0; i < 16; i++)
+	{
+		Image<byte> text(ImageRef(Renderer::w, Renderer::h));
+		for(auto& c: text)
+			c = rng();
+		pages.push_back(text);
+	}
+
+	return pages;
+}
+
+int main(int argc, char** argv)
+{
+	vector<Image<byte>> pages = load_pages(argc, argv);
+
+	const BlitKernel kernels[] = {BlitKernel::Scalar, BlitKernel::SSE2, BlitKernel::AVX2};
+	Renderer reference, ren;
+	reference.set_blit_kernel(BlitKernel::Scalar);
+
+	bool ok=true;
+	for(BlitKernel k: kernels)
+	{
+		if(!blit_kernel_available(k))
+		{
+			cout << setw(8) << blit_kernel_name(k) << ": not available\n";
+			continue;
+		}
+
+		ren.set_blit_kernel(k);
+
+		for(const auto& p: pages)
+			for(int control=0; control < 2; control++)
+				for(int flash=0; flash < 2; flash++)
+				{
+					reference.invalidate();
+					ren.invalidate();
+					const auto& a = reference.render(p, control, flash);
+					const auto& b = ren.render(p, control, flash);
+					if(!equal(a.begin(), a.end(), b.begin()))
+					{
+						cout << setw(8) << blit_kernel_name(k) << ": output differs from scalar\n";
+						ok=false;
+					}
+				}
+
+		for(int control=0; control < 2; control++)
+		{
+			const int iterations = 200;
+			auto start = chrono::steady_clock::now();
+
+			for(int i=0; i < iterations; i++)
+				for(const auto& p: pages)
+				{
+					ren.invalidate();
+					ren.render(p, control, true);
+				}
+
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			double cells = 1.0 * iterations * pages.size() * Renderer::w * Renderer::h;
+
+			cout << setw(8) << blit_kernel_name(k) << (control?" codes   ":" no codes") << ": "
+			     << setprecision(4) << cells / seconds / 1e6 << " Mcells/s\n";
+		}
+	}
+
+	return !ok;
+}
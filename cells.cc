@@ -0,0 +1,122 @@
+#include "cells.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace CVD;
+
+static_assert(sizeof(Cell) == 4, "Cells should pack into 4 bytes");
+
+bool PageCells::row_equal(const PageCells& p, int y) const
+{
+	return equal(cells[y], cells[y] + w, p.cells[y]);
+}
+
+bool PageCells::row_flashes(int y) const
+{
+	for(int x=0; x < w; x++)
+		if(cells[y][x].flash)
+			return true;
+	return false;
+}
+
+void decode_cells(const BasicImage<byte>& text, PageCells& out)
+{
+	if(text.size() != ImageRef(PageCells::w, PageCells::h))
+		throw invalid_argument("Pages must be 40x25");
+
+	//Whether this row is the bottom half of double height text on the
+	//row above.
+	bool double_height_bottom=false;
+
+	for(int y=0; y < PageCells::h; y++)
+	{
+		bool separated_graphics=false;
+		bool hold_graphics=false;
+		bool graphics_on=false;
+		bool double_height=false;
+		bool next_is_double_height=false;
+		bool flash=false;
+		int fg=7;
+		int bg=0;
+		int last_graphic=0;
+
+		for(int x=0; x < PageCells::w; x++)
+		{
+			//Teletext is 7 bit.
+			int c = text[y][x] & 0x7f;
+			Cell& cell = out[y][x];
+			cell.code = c;
+
+			if(c < 32)
+			{
+				if(c>=1 && c <=7) //Enable colour text
+				{
+					fg = c & 7;
+					graphics_on=false;
+				}
+				else if(c == 8)
+					flash=true;
+				else if(c == 9)
+					flash = false;
+				else if(c == 12)
+					double_height=false;
+				else if(c == 13)
+				{
+					double_height=true;
+					if(!double_height_bottom)
+						next_is_double_height=true;
+				}
+				else if(c >=17 && c <= 23) //Enable colour graphics
+				{
+					fg = c & 7;
+					graphics_on=true;
+				}
+				else if(c == 25) //Switch to contiguous graphics if graphics are on
+					separated_graphics=false;
+				else if(c == 26) //Switch to separated graphics if graphics are on
+					separated_graphics=true;
+				else if(c == 27) //no-op
+				{}
+				else if(c == 28) //Black bg
+					bg = 0;
+				else if(c == 29) //New background (ie. copy fg colour)
+					bg = fg;
+				else if(c == 30)
+					hold_graphics=true;
+				else if(c == 31)
+					hold_graphics=false;
+
+				//Blank glyph, or not
+				if(hold_graphics && graphics_on)
+					c = last_graphic;
+				else
+					c=0;
+			}
+
+			//Double height text on row 1 makes row 2 a bottom row. Non
+			//double height chars on row 2 are blank.
+			FontSet::Height h=FontSet::Standard;
+			if(double_height)
+				h = double_height_bottom ? FontSet::Lower : FontSet::Upper;
+
+			FontSet::Mode m = FontSet::Normal;
+			if(graphics_on)
+				m = separated_graphics ? FontSet::ThinGraphics : FontSet::Graphics;
+
+			//The last graphic drawn counts even if it isn't displayed, apparently.
+			if(graphics_on && (c & 32))
+				last_graphic=c;
+
+			cell.glyph = c;
+			cell.fg = fg;
+			cell.bg = bg;
+			cell.mode = m;
+			cell.height = h;
+			cell.flash = flash;
+			cell.hidden = double_height_bottom && !double_height;
+		}
+
+		double_height_bottom = next_is_double_height;
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef CELLS_H_q3Vd8LxTn2WcKe
+#define CELLS_H_q3Vd8LxTn2WcKe
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include "font.h"
+
+//The first half of rendering: working along each row through the
+//control codes (colour, graphics, hold, separated, double height, flash
+//and background) to find out what every cell actually shows. Drawing
+//the pixels is then just a matter of looking up each cell's glyph.
+//
+//This needs no font and no pixels, so it's cheap enough for anything
+//which wants to know what's on the page, rather than what it looks like.
+
+//One cell, after its row's control codes have been applied.
+struct Cell
+{
+	//The character to draw, which is 0 (blank) for a control code,
+	//unless graphics are being held, in which case it's the held graphic.
+	CVD::byte glyph;
+
+	//The byte on the page, 7 bit, so that control codes can be shown.
+	CVD::byte code;
+
+	//Colour numbers 0-7 (bit 0 red, bit 1 green, bit 2 blue).
+	CVD::byte fg:3, bg:3;
+
+	CVD::byte mode:2;    //FontSet::Mode
+	CVD::byte height:2;  //FontSet::Height
+
+	//Blanked in the off phase of flashing.
+	CVD::byte flash:1;
+
+	//Drawn blank whatever it holds, because it's on the bottom row of
+	//double height text but isn't double height itself.
+	CVD::byte hidden:1;
+
+	bool operator==(const Cell& c) const
+	{
+		return glyph == c.glyph && code == c.code && fg == c.fg && bg == c.bg && mode == c.mode
+		       && height == c.height && flash == c.flash && hidden == c.hidden;
+	}
+};
+
+//Every cell on the page, indexed [y][x] like the page itself.
+struct PageCells
+{
+	static const int w=40;
+	static const int h=25;
+
+	Cell cells[h][w];
+
+	Cell* operator[](int y)
+	{
+		return cells[y];
+	}
+
+	const Cell* operator[](int y) const
+	{
+		return cells[y];
+	}
+
+	//Whether row y is the same on both pages.
+	bool row_equal(const PageCells& p, int y) const;
+
+	//Whether anything on row y flashes.
+	bool row_flashes(int y) const;
+};
+
+//Works out every cell of a 40x25 page. The flash phase and whether
+//control codes are shown only matter for drawing, so they don't come
+//into it.
+void decode_cells(const CVD::BasicImage<CVD::byte>& text, PageCells& out);
+
+#endif
@@ -0,0 +1,397 @@
+#include "edit_session.h"
+#include "history.h"
+#include "sixel_plane.h"
+#include "cells.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+using namespace CVD;
+
+const char command_log_magic[8] = {'T','T','X','E','D','I','T','1'};
+
+static const int page_bytes = 40*25;
+
+//Names in scripts, in the same order as the ops.
+static const char* const names[Command::NumOps] =
+{
+	"move", "left", "right", "up", "down", "home", "end", "mode", "put",
+	"blank", "set", "fill", "empty", "code", "colour", "toggle", "insert",
+	"delete", "insert_row", "delete_row", "undo", "redo", "page",
+	"insert_sixel_column", "delete_sixel_column", "insert_sixel_row",
+	"delete_sixel_row", "mark", "line", "rectangle", "ellipse", "flood_fill"
+};
+
+static const char* const mode_names[3] = {"character", "graphics", "text"};
+
+int Command::args(Op o)
+{
+	if(o == MoveTo)
+		return 2;
+	else if(o == SetMode || o == Put || o == Code || o == Colour || o == ToggleSixels || o == Rectangle || o == Ellipse)
+		return 1;
+	else
+		return 0;
+}
+
+EditSession::EditSession(History* h)
+:text(ImageRef(40, 25), ' '),history(h)
+{}
+
+void EditSession::set_x(int x_)
+{
+	x = max(0, min(x_, text.size().x * 2-1));
+}
+
+void EditSession::set_y(int y_)
+{
+	y = max(0, min(y_, text.size().y * 3-1));
+}
+
+void EditSession::set_page(const BasicImage<byte>& page)
+{
+	if(page.size() != text.size())
+		throw CommandError("Pages must be 40x25");
+
+	if(history)
+		history->checkpoint(text);
+	copy(page.begin(), page.end(), text.begin());
+	if(history)
+		history->commit(text);
+
+	if(log)
+	{
+		log->push_back(Command::Page);
+		log->insert(log->end(), text.begin(), text.end());
+	}
+}
+
+void EditSession::record(vector<byte>* l)
+{
+	log = l;
+	if(log)
+	{
+		log->push_back(Command::Page);
+		log->insert(log->end(), text.begin(), text.end());
+	}
+}
+
+bool EditSession::apply(const Command& c)
+{
+	if(c.op >= Command::NumOps || c.op == Command::Page)
+		throw CommandError("Bad command");
+
+	if(log)
+	{
+		log->push_back(c.op);
+		if(Command::args(c.op) >= 1)
+			log->push_back(c.a);
+		if(Command::args(c.op) >= 2)
+			log->push_back(c.b);
+	}
+
+	const bool graphics = m == EditMode::Graphics;
+	const int dx = graphics ? 1 : 2;
+	const int dy = graphics ? 1 : 3;
+
+	switch(c.op)
+	{
+		case Command::MoveTo: set_x(c.a); set_y(c.b); return false;
+		case Command::Left:   set_x(x - dx); return false;
+		case Command::Right:  set_x(x + dx); return false;
+		case Command::Up:     set_y(y - dy); return false;
+		case Command::Down:   set_y(y + dy); return false;
+		case Command::Home:   set_x(0); return false;
+		case Command::End:    set_x(text.size().x * 2); return false;
+
+		case Command::SetMode:
+			if(c.a > int(EditMode::Text))
+				throw CommandError("Bad mode");
+			m = EditMode(c.a);
+			return false;
+
+		case Command::Mark:
+			mark_x = x;
+			mark_y = y;
+			return false;
+
+		case Command::Undo:
+			return history && history->undo(text);
+
+		case Command::Redo:
+			return history && history->redo(text);
+
+		default:
+			break;
+	}
+
+	//Everything else is an edit.
+	if(history)
+		history->checkpoint(text);
+
+	const bool is_graphic = current() & 32;
+
+	switch(c.op)
+	{
+		case Command::Put:
+			current() = c.a;
+			set_x(x+2);
+			break;
+
+		case Command::Blank:
+			if(!graphics)
+			{
+				current() = ' ';
+				set_x(x+2);
+			}
+			else if(is_graphic)
+			{
+				set_sixel(text, Set::Off, x, y);
+				set_x(x+1);
+			}
+			break;
+
+		case Command::SetSixel:
+			if(graphics && is_graphic)
+			{
+				set_sixel(text, Set::On, x, y);
+				set_x(x+1);
+			}
+			break;
+
+		case Command::Fill:
+			current() = 127;
+			break;
+
+		case Command::Empty:
+			if(graphics)
+				current() = 32;
+			break;
+
+		case Command::Code:
+			current() = c.a;
+			break;
+
+		case Command::Colour:
+			current() = (c.a & 7) + (graphics ? 16 : 0);
+			break;
+
+		case Command::ToggleSixels:
+			if(is_graphic)
+				current() ^= c.a & 0x5f;
+			break;
+
+		case Command::Insert:
+			if(!graphics)
+				insert_char(text, x/2, y/3);
+			else if(is_graphic)
+				insert_sixel(text, x, y);
+			break;
+
+		case Command::Delete:
+			if(!graphics)
+				delete_char(text, x/2, y/3);
+			else if(is_graphic)
+				delete_sixel(text, x, y);
+			break;
+
+		case Command::InsertRow:
+			insert_row(text, y/3);
+			break;
+
+		case Command::DeleteRow:
+			delete_row(text, y/3);
+			break;
+
+		case Command::InsertSixelColumn:
+		case Command::DeleteSixelColumn:
+		case Command::InsertSixelRow:
+		case Command::DeleteSixelRow:
+		case Command::Line:
+		case Command::Rectangle:
+		case Command::Ellipse:
+		{
+			SixelPlane p(text);
+			const ImageRef tl(min(x, mark_x), min(y, mark_y));
+			const ImageRef br(max(x, mark_x) + 1, max(y, mark_y) + 1);
+
+			if(c.op == Command::InsertSixelColumn)
+				p.insert_column(x);
+			else if(c.op == Command::DeleteSixelColumn)
+				p.delete_column(x);
+			else if(c.op == Command::InsertSixelRow)
+				p.insert_row(y);
+			else if(c.op == Command::DeleteSixelRow)
+				p.delete_row(y);
+			else if(c.op == Command::Line)
+				p.line(ImageRef(mark_x, mark_y), ImageRef(x, y), Set::On);
+			else if(c.op == Command::Rectangle)
+				p.rectangle(tl, br, Set::On, c.a);
+			else
+				p.ellipse(tl, br, Set::On, c.a);
+			p.store(text);
+			break;
+		}
+
+		case Command::FloodFill:
+			flood_fill();
+			break;
+
+		default:
+			break;
+	}
+
+	if(history)
+		return history->commit(text);
+	return true;
+}
+
+//Calls f(op, arguments) for each command in a log, and returns the
+//number of commands.
+template<class F>
+static size_t each_command(const byte* data, size_t size, const F& f)
+{
+	const byte* end = data + size;
+	size_t n=0;
+
+	while(data != end)
+	{
+		Command::Op op = Command::Op(*data++);
+		if(op >= Command::NumOps)
+			throw CommandError("Bad opcode in command log");
+
+		size_t need = op == Command::Page ? page_bytes : Command::args(op);
+		if(size_t(end - data) < need)
+			throw CommandError("Command log is cut short");
+
+		f(op, data);
+		data += need;
+		n++;
+	}
+
+	return n;
+}
+
+//Fills only spread through graphics cells in the same colours as the
+//one under the cursor.
+void EditSession::flood_fill()
+{
+	PageCells cells;
+	decode_cells(text, cells);
+	const Cell& here = cells[y/3][x/2];
+
+	SixelRow mask[SixelPlane::h];
+	for(int cy=0; cy < PageCells::h; cy++)
+	{
+		SixelRow r;
+		for(int cx=0; cx < PageCells::w; cx++)
+		{
+			const Cell& c = cells[cy][cx];
+			if(c.fg == here.fg && c.bg == here.bg)
+				r.apply(SixelRow::span(2*cx, 2*cx+2), Set::On);
+		}
+		mask[cy*3] = mask[cy*3+1] = mask[cy*3+2] = r;
+	}
+
+	SixelPlane p(text);
+	p.flood_fill(ImageRef(x, y), mask);
+	p.store(text);
+}
+
+size_t EditSession::replay(const byte* data, size_t size)
+{
+	return each_command(data, size, [&](Command::Op op, const byte* a)
+	{
+		if(op == Command::Page)
+			set_page(BasicImage<byte>(const_cast<byte*>(a), text.size()));
+		else
+			apply(Command(op, Command::args(op) >= 1 ? a[0] : 0, Command::args(op) >= 2 ? a[1] : 0));
+	});
+}
+
+bool log_uses_history(const byte* data, size_t size)
+{
+	bool used=false;
+	each_command(data, size, [&](Command::Op op, const byte*)
+	{
+		used |= op == Command::Undo || op == Command::Redo;
+	});
+	return used;
+}
+
+void dump_log(const byte* data, size_t size, ostream& out)
+{
+	each_command(data, size, [&](Command::Op op, const byte* a)
+	{
+		const int need = op == Command::Page ? page_bytes : Command::args(op);
+		out << names[op];
+
+		if(op == Command::Page)
+		{
+			out << ' ' << hex << setfill('0');
+			for(int i=0; i < need; i++)
+				out << setw(2) << int(a[i]);
+			out << dec << setfill(' ');
+		}
+		else if(op == Command::SetMode && a[0] <= int(EditMode::Text))
+			out << ' ' << mode_names[a[0]];
+		else
+			for(int i=0; i < need; i++)
+				out << ' ' << int(a[i]);
+
+		out << '\n';
+	});
+}
+
+void compile_script(istream& in, vector<byte>& log)
+{
+	string line;
+	for(int n=1; getline(in, line); n++)
+	{
+		istringstream l(line);
+		string name;
+		if(!(l >> name) || name[0] == '#')
+			continue;
+
+		auto fail = [&](const string& why)
+		{
+			throw CommandError("Line " + to_string(n) + ": " + why + ": " + line);
+		};
+
+		int op = find(names, names + Command::NumOps, name) - names;
+		if(op == Command::NumOps)
+			fail("unknown command");
+
+		log.push_back(op);
+
+		if(op == Command::Page)
+		{
+			string hex_page;
+			l >> hex_page;
+			if(hex_page.size() != 2*page_bytes || hex_page.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+				fail("page needs 2000 hex digits");
+
+			for(int i=0; i < page_bytes; i++)
+				log.push_back(stoi(hex_page.substr(2*i, 2), nullptr, 16));
+		}
+		else if(op == Command::SetMode)
+		{
+			string mode;
+			l >> mode;
+			int m = find(mode_names, mode_names + 3, mode) - mode_names;
+			if(m == 3)
+				fail("unknown mode");
+			log.push_back(m);
+		}
+		else
+			for(int i=0; i < Command::args(Command::Op(op)); i++)
+			{
+				int a;
+				if(!(l >> a) || a < 0 || a > 255)
+					fail("expected a number from 0 to 255");
+				log.push_back(a);
+			}
+	}
+}
@@ -0,0 +1,169 @@
+#ifndef EDIT_SESSION_H_Vn7cK2pXwR4sJd
+#define EDIT_SESSION_H_Vn7cK2pXwR4sJd
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <stdexcept>
+#include "page_edit.h"
+
+class History;
+
+//Editing a page the way the editor does, with a cursor and a mode, but
+//without any UI. The editor turns keys into commands and hands them to
+//an EditSession, and so can anything else, so sessions can be recorded,
+//replayed and scripted.
+//
+//Commands can be recorded into a log, which is compact enough to keep
+//everything: an opcode byte, followed by its arguments (see Command).
+
+struct CommandError: public std::runtime_error
+{
+	using std::runtime_error::runtime_error;
+};
+
+enum class EditMode
+{
+	Character,  //Moves by cells; keys put control codes
+	Graphics,   //Moves by sixels; colours are graphics colours
+	Text        //Keys put characters
+};
+
+struct Command
+{
+	enum Op: CVD::byte
+	{
+		MoveTo,         //a, b: cursor position in sixels
+		Left,           //Moving goes by sixels in graphics mode, cells otherwise
+		Right,
+		Up,
+		Down,
+		Home,
+		End,
+		SetMode,        //a: EditMode
+		Put,            //a: character to put at the cursor, which then moves on
+		Blank,          //Clear the sixel (and move on) in graphics mode, or put a space
+		SetSixel,       //Set the sixel and move on (graphics mode only)
+		Fill,           //Put a solid block
+		Empty,          //Put an empty graphic (graphics mode only)
+		Code,           //a: character to put at the cursor, which stays put
+		Colour,         //a: colour 1-7, put as text or graphics depending on the mode
+		ToggleSixels,   //a: bits to flip, if the cell is a graphic
+		Insert,         //A sixel in graphics mode, otherwise a cell
+		Delete,
+		InsertRow,
+		DeleteRow,
+		Undo,
+		Redo,
+
+		//Replace the whole page, which is followed by the 40x25 bytes of
+		//the page in the log. Not applied with apply(); use set_page().
+		Page,
+
+		//Whole columns and rows of sixels at the cursor. Columns only
+		//move along as far as the graphics go on each row, like Insert.
+		InsertSixelColumn,
+		DeleteSixelColumn,
+		InsertSixelRow,
+		DeleteSixelRow,
+
+		//Tools drawing sixels between the mark and the cursor, in the
+		//graphics cells only. Each is a single edit, however much it draws.
+		Mark,           //Put the mark at the cursor
+		Line,
+		Rectangle,      //a: filled
+		Ellipse,        //a: filled, in the rectangle
+		FloodFill,      //Flip the area at the cursor, up to cells of other colours
+
+		NumOps
+	};
+
+	Op op;
+	CVD::byte a=0, b=0;
+
+	Command(Op o, int a_=0, int b_=0)
+	:op(o),a(a_),b(b_)
+	{}
+
+	//Number of argument bytes following the opcode in a log (not
+	//counting the page after Page).
+	static int args(Op o);
+};
+
+class EditSession
+{
+	CVD::Image<CVD::byte> text;
+	int x=4, y=6;
+	int mark_x=4, mark_y=6;
+	EditMode m=EditMode::Character;
+	History* history;
+	std::vector<CVD::byte>* log=nullptr;
+
+	CVD::byte& current()
+	{
+		return text[y/3][x/2];
+	}
+
+	void set_x(int x);
+	void set_y(int y);
+	void flood_fill();
+
+	public:
+
+	//Starts with a blank page. Edits are recorded in the history, if
+	//there is one, which is also what Undo and Redo use.
+	EditSession(History* h=nullptr);
+
+	const CVD::Image<CVD::byte>& page() const
+	{
+		return text;
+	}
+
+	//Cursor position in sixels.
+	int cursor_x() const
+	{
+		return x;
+	}
+
+	int cursor_y() const
+	{
+		return y;
+	}
+
+	EditMode mode() const
+	{
+		return m;
+	}
+
+	//Replace the page (e.g. with a file just loaded), as an edit which
+	//can be undone.
+	void set_page(const CVD::BasicImage<CVD::byte>& page);
+
+	//Returns whether the page might have changed.
+	bool apply(const Command& c);
+
+	//Append every command from now on to the log (or stop, with nullptr).
+	//The current page goes in first, so the log stands on its own.
+	void record(std::vector<CVD::byte>* log);
+
+	//Apply a whole log. Returns the number of commands. Throws
+	//CommandError if the log is cut short or has a bad opcode.
+	size_t replay(const CVD::byte* data, size_t size);
+};
+
+//Whether a log has any Undo or Redo commands. Replaying is much faster
+//without a history, so there's no point keeping one if it isn't used.
+bool log_uses_history(const CVD::byte* data, size_t size);
+
+//Log files are this, followed by the commands.
+extern const char command_log_magic[8];
+
+//Logs as text, one command per line, e.g. "move 10 12" or "colour 3",
+//for reading, or for writing by hand or from scripts. Blank lines and
+//lines starting with # are ignored. compile_script throws CommandError
+//on anything it doesn't understand.
+void dump_log(const CVD::byte* data, size_t size, std::ostream& out);
+void compile_script(std::istream& in, std::vector<CVD::byte>& log);
+
+#endif
@@ -6,6 +6,11 @@
 #include <sstream>
 #include <cstring>
 #include <cerrno>
+#include <fstream>
+#include <unistd.h>
+#include <functional>
+#include <memory>
+#include <chrono>
 
 #include <cvd/image_io.h>
 #include <cvd/gl_helpers.h>
@@ -26,6 +31,13 @@
 
 
 #include "render.h"
+#include "font.h"
+#include "history.h"
+#include "archive.h"
+#include "page_edit.h"
+#include "edit_session.h"
+#include "page_io.h"
+#include "trace.h"
 
 using namespace std;
 using namespace CVD;
@@ -34,6 +46,20 @@ class MainUI;
 
 class VDUDisplay: public Fl_Window
 {
+	typedef pair<ImageRef, ImageRef> Area;
+
+	//The rendered frame with the cursor and grid drawn on top. Only the
+	//parts which have been damaged get recomposed and sent to the screen.
+	Image<Rgb<byte>> composed;
+	const void* last_frame=nullptr;
+	Area drawn_cursor;
+	vector<Area> pending;
+
+	void damage_area(const Area& a);
+	void compose(const Area& a);
+	void upload(const Area& a);
+	void draw_timing();
+
 	public:
 	MainUI& ui;
 	VDUDisplay(MainUI& u)
@@ -43,25 +69,22 @@ class VDUDisplay: public Fl_Window
 		
 	}
 
+	//Redraw just the cells under the old and new cursor
+	void cursor_moved();
+
 	virtual void draw();
 };
 
 class MainUI: public Fl_Window
 {
-	enum class Mode
-	{
-		Character,
-		Graphics,
-		Text
-	};
-
-	Fl_Menu_Item menus[14]=
+	Fl_Menu_Item menus[17]=
 	{
 	  {"&File",0,0,0,FL_SUBMENU,0,0,0,0},
 		{"&Open",   FL_ALT+'o' ,   open_callback_s, this, 0,0,0,0,0},
 		{"&Save",   FL_CTRL+'s',save_callback_s,    this, 0, 0, 0, 0, 0},
 		{"Save &as",          0,save_as_callback_s, this, 0, 0, 0, 0, 0},
 		{"Save a &copy",          0,save_a_copy_callback_s, this, 0, 0, 0, 0, 0},
+		{"Save &trace",           0,save_trace_callback_s, this, 0, 0, 0, 0, 0},
 		{"&Quit",	FL_ALT+'q' ,                    NULL, 0, FL_MENU_DIVIDER,0,0,0,0},
 	  {0,0,0,0,0,0,0,0,0},
 	  {"&Edit",0,0,0,FL_SUBMENU,0,0,0,0},
@@ -69,6 +92,8 @@ class MainUI: public Fl_Window
 	  {"Codes", FL_F+1, menu_toggle_callback_s, this, FL_MENU_TOGGLE + FL_MENU_VALUE, 0,0,0,0},
 	  {"Grid",  FL_F+2, menu_toggle_callback_s, this, FL_MENU_TOGGLE                , 0,0,0,0},
 	  {"Blink",  FL_F+3, menu_toggle_callback_s, this, FL_MENU_TOGGLE                , 0,0,0,0},
+	  {"Smooth", FL_F+4, menu_toggle_callback_s, this, FL_MENU_TOGGLE                , 0,0,0,0},
+	  {"Timing", FL_F+5, menu_toggle_callback_s, this, FL_MENU_TOGGLE                , 0,0,0,0},
 	  {0,0,0,0,0,0,0,0,0},
 	};
 
@@ -76,81 +101,98 @@ class MainUI: public Fl_Window
 	Renderer ren;
 	const ImageRef screen_size;
 	Fl_Menu_Bar* menu;
-	Fl_Group* group_B;
-	const Fl_Menu_Item* codes_toggle, *grid_toggle,*blink_toggle;
-	VDUDisplay* vdu;
+	Fl_Group* group_B=nullptr;
+	const Fl_Menu_Item* codes_toggle, *grid_toggle,*blink_toggle,*smooth_toggle,*timing_toggle;
+	VDUDisplay* vdu=nullptr;
 
 	static const int menu_height=30;
 	static const int initial_pad=10;
-	Image<byte> buffer;
-	int cursor_x_sixel=4;
-	int cursor_y_sixel=6;
-
-	Mode mode = Mode::Character;
 	bool cursor_blink_on=true;
 	double cursor_blink_time=.2;
 	double text_blink_time=.5;
 	bool text_blink_on=true;
 	bool show_control=1;
-	bool checkpoint_issued=0;
+	bool smoothed=false;
 
 	string save_name;
 	string err;
 
-	vector<Image<byte>> history, redo_buffer;
-	
-	void checkpoint()
+	//The page as it was last loaded or saved, and the autosave last
+	//written against it.
+	Image<byte> saved_page;
+	vector<byte> autosaved;
+	bool autosave_busy=false;
+	static constexpr double autosave_time=5;
+
+	History history;
+	EditSession session{&history};
+
+	//The session being recorded, if any. Commands are written out as
+	//they happen, so nothing is lost if the editor is killed.
+	vector<byte> log;
+	ofstream log_file;
+
+	IOWorker io;
+
+	void flush_log()
 	{
-		history.push_back(buffer);
-		checkpoint_issued=1;
-		vdu->redraw();
+		if(!log_file.is_open() || log.empty())
+			return;
+
+		log_file.write(reinterpret_cast<const char*>(log.data()), log.size());
+		log_file.flush();
+		log.clear();
 	}
-	
-	//Never duplicate checkpoint states. Explicitly checking states
-	//makes logic with respect to complex sixel mangling easier.
-	void process_checkpoint()
+
+	//Carry out a command and update the display to match.
+	void run(const Command& c)
 	{
-		if(checkpoint_issued)
-		{
-			if(equal(buffer.begin(), buffer.end(), history.back().begin()))
-			{
-				history.pop_back();
-			}
-			else
-			{
-				redo_buffer.clear();
-			}
-		}
-		checkpoint_issued=0;
+		const int x = session.cursor_x(), y = session.cursor_y();
+		const EditMode m = session.mode();
+
+		if(session.apply(c))
+			invalidate(Content);
+
+		if(x != session.cursor_x() || y != session.cursor_y() || m != session.mode())
+			cursor_change();
+
+		flush_log();
 	}
 
-	void undo()
+	static void menu_toggle_callback_s(Fl_Widget*, void * ui)
 	{
-		if(!history.empty())
-		{
-			redo_buffer.push_back(buffer);
-			buffer=history.back();
-			history.pop_back();
-			vdu->redraw();
-		}
+		//Fl_Menu_ *m = static_cast<Fl_Menu_*>(w);
+		//const Fl_Menu_Item *i = m->mvalue();
+		static_cast<MainUI*>(ui)->update_scale();
+		static_cast<MainUI*>(ui)->invalidate(Everything);
 	}
 
-	void redo()
+	//The page is drawn at the largest whole multiple of its native size
+	//which fits in the window.
+	void update_scale()
 	{
-		if(!redo_buffer.empty())
+		if(!vdu)
+			return;
+
+		int scale = min((group_B->w() - 2*pad) / screen_size.x, (group_B->h() - 2*pad) / screen_size.y);
+		scale = max(1, min(FontSet::max_scale, scale));
+		bool rounding = smooth_toggle->value();
+
+		if(scale != ren.scale() || rounding != smoothed)
 		{
-			history.push_back(buffer);
-			buffer=redo_buffer.back();
-			redo_buffer.pop_back();
-			vdu->redraw();
+			ren.set_scale(scale, rounding);
+			smoothed = rounding;
+			invalidate(Everything);
 		}
+
+		//FLTK stretches the display along with the window, so put it back.
+		vdu->resize(pad, pad, screen_size.x * scale, screen_size.y * scale);
 	}
 
-	static void menu_toggle_callback_s(Fl_Widget*, void * ui)
+	void resize(int x, int y, int w, int h) override
 	{
-		//Fl_Menu_ *m = static_cast<Fl_Menu_*>(w);
-		//const Fl_Menu_Item *i = m->mvalue();
-		static_cast<MainUI*>(ui)->vdu->redraw();
+		Fl_Window::resize(x, y, w, h);
+		update_scale();
 	}
 
 
@@ -207,10 +249,14 @@ class MainUI: public Fl_Window
 			codes_toggle=menu->find_item("Codes");
 			grid_toggle=menu->find_item("Grid");
 			blink_toggle=menu->find_item("Blink");
+			smooth_toggle=menu->find_item("Smooth");
+			timing_toggle=menu->find_item("Timing");
 
 			assert(codes_toggle != NULL);
 			assert(grid_toggle != NULL);
 			assert(blink_toggle != NULL);
+			assert(smooth_toggle != NULL);
+			assert(timing_toggle != NULL);
 
 			group_B = new Fl_Window(0, menu_height, w(), h()-menu_height, "");	
 			group_B->begin();
@@ -224,165 +270,394 @@ class MainUI: public Fl_Window
 		end();
 		resizable(group_B); //Make group B the fully resizable widget
 
-		buffer.resize(ImageRef(ren.w, ren.h));
-		buffer.fill(' ');
+		saved_page.copy_from(session.page());
+		callback(my_callback_s, this);
+
 		show();
+		window_shown(true);
+	}
 
-		Fl::add_timeout(cursor_blink_time, cursor_callback, this);
-		Fl::add_timeout(text_blink_time, text_flash_callback, this);
+	//The bounding box in pixels of the cursor
+	pair<ImageRef, ImageRef> cursor_area()
+	{
+		ImageRef tl, size;
+		const int x = session.cursor_x(), y = session.cursor_y();
+		if(session.mode() == EditMode::Graphics)
+			tie(tl,size) = ren.sixel_area(x, y);
+		else if(session.mode() == EditMode::Text)
+		{
+			tie(tl,size) = ren.char_area_under_sixel(x, y);
+			size.x = 4 * ren.scale();
+		}	
+		else
+			tie(tl,size) = ren.char_area_under_sixel(x, y);
 
-		callback(my_callback_s);
+		return make_pair(tl, size);
 	}
 
 	const Image<Rgb<byte>> get_rendered_text(int)
 	{
-		return ren.render(buffer, codes_toggle->value(), text_blink_on || !blink_toggle->value());
+		const Image<Rgb<byte>>& i = ren.render(session.page(), codes_toggle->value(), text_blink_on || !blink_toggle->value());
+		update_flashing();
+		return i;
 	}
 
-	static void cursor_callback(void* d)
+	//Flashing only needs the scheduler to wake up if something on the page
+	//flashes. The two phases are cached by the renderer, so a tick is
+	//cheap, but on a page with no flash codes there's no point at all.
+	void update_flashing()
 	{
-		MainUI* m = static_cast<MainUI*>(d);
-		m->cursor_blink_on ^= true;
-		m->vdu->redraw();
-		Fl::repeat_timeout(m->cursor_blink_time, cursor_callback, d);
+		bool needed = ren.flashing() && blink_toggle->value();
+
+		if(needed == flashing)
+			return;
+		else if(needed)
+			next_text_flash = now() + text_blink_time;
+		else
+			text_blink_on=true;
+
+		flashing = needed;
+		schedule();
 	}
 
 	void cursor_change()
 	{
 		cursor_blink_on=true;
-		Fl::remove_timeout(cursor_callback, this);
-		Fl::add_timeout(cursor_blink_time, cursor_callback, this);
-		vdu->redraw();
+		next_cursor_blink = now() + cursor_blink_time;
+		invalidate(Cursor);
 	}
 
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Frame scheduling
+	//
+	// Anything which might change what's on screen says why, and the causes
+	// are gathered up until the next display refresh, when at most one
+	// frame is drawn. So a key which edits the page and moves the cursor
+	// just as the cursor blinks still only draws once, and a frame which
+	// would look the same as the last one isn't drawn at all.
+	//
+	// A single timeout drives the lot. It's set for whichever comes first
+	// out of the next frame, the cursor blinking and the text flashing, and
+	// while the window is hidden or iconified there are no timeouts at all.
+
+	enum Cause
+	{
+		Content=1,    //The page or the way it's shown
+		Cursor=2,     //The cursor moved or blinked
+		Flash=4,      //Flashing text changed phase
+		Everything=8, //Redraw no matter what
+	};
+
+	unsigned causes=0;
+	bool hidden=true;
+	bool flashing=false;
+	double last_frame=0, next_cursor_blink=0, next_text_flash=0;
+	static constexpr double frame_time=1./60;
 
-	static void text_flash_callback(void* d)
+	//What the last frame showed.
+	Image<byte> shown_page;
+	bool shown_codes=false, shown_grid=false, shown_flash=false, shown_cursor_on=false;
+	pair<ImageRef, ImageRef> shown_cursor;
+
+	static double now()
 	{
-		MainUI* m = static_cast<MainUI*>(d);
-		m->text_blink_on ^= true;
-		m->vdu->redraw();
-		Fl::repeat_timeout(m->text_blink_time, text_flash_callback, d);
+		return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
 	}
 
-	void set_x(int x)
+	void invalidate(unsigned c)
 	{
-		cursor_x_sixel = max(0, min(x, ren.w * 2-1));
-		cursor_change();
+		causes |= c;
+		schedule();
 	}
-	void set_y(int y)
+
+	void schedule()
 	{
-		cursor_y_sixel = max(0, min(y, ren.h * 3-1));
-		cursor_change();
+		Fl::remove_timeout(tick_s, this);
+
+		if(hidden)
+			return;
+
+		double t = next_cursor_blink;
+		if(flashing)
+			t = min(t, next_text_flash);
+		if(causes)
+			t = min(t, last_frame + frame_time);
+
+		Fl::add_timeout(max(0., t - now()), tick_s, this);
 	}
-	void advance()
+
+	static void tick_s(void* d)
 	{
-		set_x(cursor_x_sixel+2);
+		static_cast<MainUI*>(d)->tick();
 	}
 
-	int xc()
+	void tick()
 	{
-		return cursor_x_sixel/2;
+		const double t = now();
+
+		if(t >= next_cursor_blink)
+		{
+			cursor_blink_on ^= true;
+			next_cursor_blink = t + cursor_blink_time;
+			causes |= Cursor;
+		}
+
+		if(flashing && t >= next_text_flash)
+		{
+			text_blink_on ^= true;
+			next_text_flash = t + text_blink_time;
+			causes |= Flash;
+		}
+
+		if(causes && t >= last_frame + frame_time)
+			frame();
+
+		schedule();
 	}
-	int yc()
+
+	//Work out what, if anything, needs drawing. The flash phase only
+	//matters if something flashes, and if only the cursor has changed,
+	//only the cells under it need drawing.
+	void frame()
 	{
-		return cursor_y_sixel/3;
+		update_flashing();
+
+		const bool flash_on = text_blink_on || !blink_toggle->value();
+		const auto cursor = cursor_area();
+		const BasicImage<byte>& page = session.page();
+
+		bool content = (causes & Everything) || shown_page.size() != page.size()
+		               || shown_codes != bool(codes_toggle->value()) || shown_grid != bool(grid_toggle->value())
+		               || (shown_flash != flash_on && ren.flashing())
+		               || !equal(page.begin(), page.end(), shown_page.begin());
+
+		if(content)
+			vdu->redraw();
+		else if(cursor != shown_cursor || cursor_blink_on != shown_cursor_on)
+			vdu->cursor_moved();
+
+		shown_page.copy_from(page);
+		shown_codes = codes_toggle->value();
+		shown_grid = grid_toggle->value();
+		shown_flash = flash_on;
+		shown_cursor = cursor;
+		shown_cursor_on = cursor_blink_on;
+
+		last_frame = now();
+		causes = 0;
+	}
+
+	//Nothing is scheduled while the window can't be seen. Autosaving
+	//stops too, since nothing can change, but whatever was pending is
+	//written out first.
+	void window_shown(bool s)
+	{
+		if(s == !hidden)
+			return;
+
+		hidden = !s;
+		if(hidden)
+		{
+			Fl::remove_timeout(tick_s, this);
+			Fl::remove_timeout(autosave_callback, this);
+			autosave();
+		}
+		else
+		{
+			cursor_blink_on = text_blink_on = true;
+			next_cursor_blink = now() + cursor_blink_time;
+			next_text_flash = now() + text_blink_time;
+			Fl::add_timeout(autosave_time, autosave_callback, this);
+			invalidate(Everything);
+		}
 	}
 
 	////////////////////////////////////////////////////////////////////////////////
 	//
-	// Stuff relating to getting and setting characters and sixels
+	// Functions relating to saving.
 	//
+	// Files are read and written by the I/O thread, so a slow disk never
+	// stalls the editor. The jobs only touch the copies they're given, and
+	// hand the results back to be dealt with on the UI thread.
 
-	enum class Set
+	//Run a function on the UI thread, from any thread.
+	static void on_ui_thread(function<void()> f)
 	{
-		Off = 0,
-		On  = 1,
-		Toggle = 2
-	};
+		Fl::awake(on_ui_thread_s, new function<void()>(move(f)));
+	}
 
-	byte& crnt()
+	static void on_ui_thread_s(void* d)
 	{
-		return  buffer[yc()][xc()];
+		unique_ptr<function<void()>> f(static_cast<function<void()>*>(d));
+		(*f)();
 	}
 
-	void set_sixel(Set way)
+	//Pages cross between the threads as plain vectors. Copies of a
+	//CVD::Image share a reference count which isn't thread safe, so an
+	//Image must never be captured by a job.
+	typedef shared_ptr<vector<byte>> PageData;
+
+	static PageData page_data(const BasicImage<byte>& page)
 	{
-		set_sixel(way, cursor_x_sixel, cursor_y_sixel);
+		return make_shared<vector<byte>>(page.data(), page.data() + page.size().area());
 	}
-	
-	void set_sixel(bool s, int x, int y)
+
+	static BasicImage<byte> page_view(const PageData& d, ImageRef size)
 	{
-		if(s)
-			set_sixel(Set::On, x, y);
-		else
-			set_sixel(Set::Off, x, y);
+		return BasicImage<byte>(d->data(), size);
 	}
 
-	bool get_sixel(int x, int y)
+	void show_error(const string& e)
 	{
-		int o = x%2 + 2 * (y%3);
-		//But bits go 1,2,4,8,16, 64
-		if(o ==5)
-			o = 6;
-
-		int mask = (1 << o);
-		
-		return static_cast<bool>(buffer[y/3][x/2] & mask);
+		err = e;
+		fl_choice(err.c_str(), "Horsefeathers!", "Gosh darn it!", ":(");	
 	}
-	
-	bool is_graphic()
+
+	void actually_save(const string& name, bool remember)
 	{
-		return crnt()&32;
-	}	
+		const PageData page = page_data(session.page());
+		const ImageRef size = session.page().size();
 
-	void set_sixel(Set way, int x, int y)
+		io.run([=]()
+		{
+			try
+			{
+				string saved_name = save_page(name, page_view(page, size));
+				on_ui_thread([=](){ saved(saved_name, page_view(page, size), remember); });
+			}
+			catch(runtime_error& e)
+			{
+				string what = e.what();
+				on_ui_thread([=](){ show_error(what); });
+			}
+		});
+	}
+
+	//Once the page is safely on disk, the autosave made against the
+	//previous copy is no longer needed.
+	void saved(const string& name, const BasicImage<byte>& page, bool remember)
 	{
-		int o = x%2 + 2 *(y%3);
-		//But bits go 1,2,4,8,16, 64
-		if(o ==5)
-			o = 6;
+		if(!remember)
+			return;
 
-		int mask = (1 << o);
+		const string old_autosave = autosave_name(save_name);
+		save_name = name;
+		label(save_name.c_str());
+		saved_page.copy_from(page);
+		autosaved.clear();
 
-		if(way == Set::On)
-			buffer[y/3][x/2] |= mask;
-		else if(way == Set::Off)
-			buffer[y/3][x/2] &= ~mask;
-		else if(way == Set::Toggle)
-			buffer[y/3][x/2] ^= mask;
+		io.run([=]()
+		{
+			try
+			{
+				remove_file(old_autosave);
+			}
+			catch(PageIOError& e)
+			{
+				cerr << e.what() << endl;
+			}
+		});
 	}
 
-	int next_non_graphic_char()
+	//Runs on the I/O thread. Returns the name the page was saved as.
+	static string save_page(const string& name, const BasicImage<byte>& page)
 	{
-		//Search for next non-graphic
-		int end=xc();
-		for(; end < ren.w; end++)
-			if(!( buffer[yc()][end] & 32))
-				break;
-		return end;
+		string file;
+		int p, subpage;
+
+		if(parse_archive_name(name, file, p, subpage))
+			return save_to_archive(file, p, subpage, page);
+
+		replace_file(name, page.data(), page.size().area());
+		return name;
 	}
 
-	
-	////////////////////////////////////////////////////////////////////////////////
-	//
-	// Functions relating to saving.
-	//
-	// this is surprisingly messy
-	void actually_save(const string& name, bool remember)
+	//Adding a page to an archive is safe in place: nothing live is
+	//overwritten until the new page is on disk. A new archive is created
+	//empty first, like saving a page file. With no page number, the page
+	//is added after the last one in the archive.
+	static string save_to_archive(const string& file, int page, int subpage, const BasicImage<byte>& text)
 	{
-		ofstream out(name);
-		out.write(reinterpret_cast<char*>(buffer.data()), buffer.size().area());
-		
-		if(!out.good())
+		if(access(file.c_str(), F_OK) != 0)
+			replace_file(file, [](const string& tmp){ PageArchive::create(tmp); });
+
+		PageArchive a(file, true);
+
+		if(page == -1)
 		{
-			err = "Error saving to \"" + name + "\": " + strerror(errno);	
-			fl_choice(err.c_str(), "Horsefeathers!", "Gosh darn it!", ":(");	
+			page = 0x100;
+			subpage = 0;
+			if(a.size())
+			{
+				page = a.entry(a.size()-1).page;
+				subpage = a.entry(a.size()-1).subpage + 1;
+			}
+
+			//Subpages are 16 bits, so carry on with the next page.
+			if(subpage > 0xffff)
+			{
+				subpage = 0;
+				page++;
+			}
+
+			if(page > 0xffff)
+				throw ArchiveError("There's no room for another page in \"" + file + "\"");
 		}
-		else if(remember)
+
+		a.add(page, max(subpage, 0), "", text);
+		return archive_name(file, page, max(subpage, 0));
+	}
+
+	//Every so often, the changes since the last save are written out, so
+	//that they can be recovered if the editor dies. Only one autosave is
+	//in flight at a time, and nothing is written if nothing has changed.
+	static void autosave_callback(void* d)
+	{
+		static_cast<MainUI*>(d)->autosave();
+		Fl::repeat_timeout(autosave_time, autosave_callback, d);
+	}
+
+	void autosave()
+	{
+		if(autosave_busy)
+			return;
+
+		vector<byte> a = make_autosave(saved_page, session.page());
+		if(a == autosaved)
+			return;
+
+		autosaved = a;
+		autosave_busy = true;
+		const string name = autosave_name(save_name);
+
+		io.run([=]()
 		{
-			save_name = name;
-			label(save_name.c_str());
-		}
+			string error;
+			try
+			{
+				if(a.empty())
+					remove_file(name);
+				else
+					replace_file(name, a.data(), a.size());
+			}
+			catch(PageIOError& e)
+			{
+				error = e.what();
+			}
+
+			on_ui_thread([=]()
+			{
+				autosave_busy = false;
+
+				//Try again next time.
+				if(!error.empty())
+				{
+					cerr << error << endl;
+					autosaved.clear();
+				}
+			});
+		});
 	}
 	
 	static void save_callback_s(Fl_Widget*, void * ui)
@@ -393,7 +668,7 @@ class MainUI: public Fl_Window
 	{
 		if(save_name == "")
 		{
-			Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tAll files (*)", Fl_File_Chooser::CREATE, "Save as...");
+			Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tArchives (*.ttxa)\tAll files (*)", Fl_File_Chooser::CREATE, "Save as...");
 			file->callback(save_dialog_callback_s, this);
 			file->show();
 		}
@@ -409,7 +684,7 @@ class MainUI: public Fl_Window
 	}
 	void save_as_callback()
 	{
-		Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tAll files (*)", Fl_File_Chooser::CREATE, "Save as...");
+		Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tArchives (*.ttxa)\tAll files (*)", Fl_File_Chooser::CREATE, "Save as...");
 		file->callback(save_dialog_callback_s, this);
 		file->show();
 	}
@@ -421,7 +696,7 @@ class MainUI: public Fl_Window
 	}
 	void save_a_copy_callback()
 	{
-		Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tAll files (*)", Fl_File_Chooser::CREATE, "Save as...");
+		Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tArchives (*.ttxa)\tAll files (*)", Fl_File_Chooser::CREATE, "Save as...");
 		file->callback(save_a_copy_dialog_callback_s, this);
 		file->show();
 	}
@@ -438,6 +713,38 @@ class MainUI: public Fl_Window
 			((MainUI*)ui)->actually_save(w->value(), false);
 	}
 	
+	//The trace is gathered up here, since it's a snapshot of the rings,
+	//but written out on the I/O thread like everything else.
+	static void save_trace_callback_s(Fl_Widget*, void * ui)
+	{
+		static_cast<MainUI*>(ui)->save_trace();
+	}
+	void save_trace()
+	{
+		if(!Trace::enabled)
+		{
+			show_error("There's no trace: the editor was built without tracing (make TRACE=1)");
+			return;
+		}
+
+		ostringstream o;
+		Trace::write_chrome_json(o);
+		const string json = o.str(), name = "trace.json";
+
+		io.run([=]()
+		{
+			try
+			{
+				replace_file(name, json.data(), json.size());
+			}
+			catch(PageIOError& e)
+			{
+				string what = e.what();
+				on_ui_thread([=](){ show_error(what); });
+			}
+		});
+	}
+
 	////////////////////////////////////////////////////////////////////////////////
 	//
 	// Loading (much cleaner)
@@ -445,33 +752,118 @@ class MainUI: public Fl_Window
 	//
 	void load(const string& name)
 	{
-		ifstream in(name);
+		const ImageRef size = session.page().size();
 
-		Image<byte> tmp(buffer.size());
-		in.read(reinterpret_cast<char*>(tmp.data()), buffer.size().area());
-		
-		if(!in.good())
+		io.run([=]()
 		{
-			err = "Error reading from\"" + name + "\": " + strerror(errno);	
-			fl_choice(err.c_str(), "Horsefeathers!", "Gosh darn it!", ":(");	
-		}
-		else
+			try
+			{
+				PageData page = make_shared<vector<byte>>(size.area());
+				BasicImage<byte> view = page_view(page, size);
+				string loaded_name = load_page(name, view);
+				vector<byte> autosave;
+				read_file(autosave_name(loaded_name), autosave);
+				on_ui_thread([=](){ loaded(loaded_name, page_view(page, size), autosave); });
+			}
+			catch(runtime_error& e)
+			{
+				string what = e.what();
+				on_ui_thread([=](){ show_error(what); });
+			}
+		});
+	}
+
+	//Unsaved work on a page with no name can still be recovered. Its
+	//autosave is made against the blank page.
+	void recover_untitled()
+	{
+		const PageData blank = page_data(saved_page);
+		const ImageRef size = saved_page.size();
+
+		io.run([=]()
+		{
+			try
+			{
+				vector<byte> autosave;
+				if(read_file(autosave_name(""), autosave))
+					on_ui_thread([=](){ offer_recovery(page_view(blank, size), autosave); });
+			}
+			catch(PageIOError& e)
+			{
+				cerr << e.what() << endl;
+			}
+		});
+	}
+
+	void loaded(const string& name, const BasicImage<byte>& page, const vector<byte>& autosave)
+	{
+		save_name = name;
+		label(save_name.c_str());
+		saved_page.copy_from(page);
+		autosaved.clear();
+		session.set_page(page);
+		offer_recovery(page, autosave);
+
+		flush_log();
+		invalidate(Content);
+	}
+
+	//Recovering is an edit like any other, so it can be undone, and the
+	//autosave stays until the page is saved.
+	void offer_recovery(const BasicImage<byte>& page, const vector<byte>& autosave)
+	{
+		Image<byte> recovered;
+		recovered.copy_from(page);
+		if(autosave.empty() || !apply_autosave(autosave, recovered))
+			return;
+
+		const string q = "There are unsaved changes to \"" + (save_name.empty() ? string("untitled") : save_name) + "\" from an earlier session.";
+		if(fl_choice("%s", "Discard them", "Recover them", 0, q.c_str()) == 1)
 		{
-			save_name = name;
-			label(save_name.c_str());
-			checkpoint();
-			buffer=tmp;
-			process_checkpoint();
+			session.set_page(recovered);
+			autosaved = autosave;
+			flush_log();
+			invalidate(Content);
 		}
 	}
 
+	//Runs on the I/O thread. Returns the name the page was loaded from.
+	static string load_page(const string& name, BasicImage<byte>& page)
+	{
+		string file;
+		int p, subpage;
+
+		if(parse_archive_name(name, file, p, subpage))
+			return load_from_archive(file, p, subpage, page);
+
+		read_page(name, page);
+		return name;
+	}
+
+	//With no page number, the first page in the archive is loaded.
+	static string load_from_archive(const string& file, int page, int subpage, BasicImage<byte>& tmp)
+	{
+		PageArchive a(file);
+
+		long i = a.size() ? 0 : -1;
+		if(page != -1)
+			i = a.find(page, max(subpage, 0));
+
+		if(i == -1)
+			throw ArchiveError("There's no such page in \"" + file + "\"");
+
+		BasicImage<byte> p = a.page(i);
+		copy(p.data(), p.data() + p.size().area(), tmp.data());
+		return archive_name(file, a.entry(i).page, a.entry(i).subpage);
+	}
+
 	static void open_callback_s(Fl_Widget*, void * ui)
 	{
 		static_cast<MainUI*>(ui)->open_callback();
 	}
 	void open_callback()
 	{
-		Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tAll files (*)", Fl_File_Chooser::SINGLE, "Open");
+		Fl_File_Chooser* file = new Fl_File_Chooser(".", "Text (*.txt)\tArchives (*.ttxa)\tAll files (*)", Fl_File_Chooser::SINGLE, "Open");
 		file->callback(open_dialog_callback_s, this);
 		file->show();
 	}
@@ -481,10 +873,13 @@ class MainUI: public Fl_Window
 			((MainUI*)ui)->load(w->value());
 	}
 	
-	static void my_callback_s(Fl_Widget*, void*) 
+	static void my_callback_s(Fl_Widget*, void* ui) 
 	{   
 		if (Fl::event()==FL_SHORTCUT && Fl::event_key()==FL_Escape)     
 			return; // ignore Escape  
+
+		//Let any saves finish first.
+		static_cast<MainUI*>(ui)->io.finish();
 		exit(0);
 	}
 
@@ -494,232 +889,124 @@ class MainUI: public Fl_Window
 	// Main event handler
 	//
 	
-	//Should probably write this as a bunch of support functions and
-	//calls to those functions, so it can be scripted easily.
+	//Keys are turned into commands for the session (see edit_session.h),
+	//which does the actual editing, so it can be scripted easily.
 
 	int handle(int e) override
 	{
+		if(e == FL_SHOW || e == FL_HIDE)
+		{
+			int r = Fl_Window::handle(e);
+			window_shown(e == FL_SHOW);
+			return r;
+		}
 
 		if(e == FL_KEYBOARD)
 		{	
 			int k = Fl::event_key();
-			cerr << "-->" << Fl::event_text() << "<--\n";
-			
-			//Decide whether to move in sixels or characters
-			int dx=1;
-			int dy=1;
-			if(mode != Mode::Graphics)
-			{
-				dx=2;
-				dy=3;
-			}
+			TRACE_SCOPE_VALUE("key", k);
+			const EditMode mode = session.mode();
 
 			if(k == FL_Left)
-				set_x(cursor_x_sixel-dx);
+				run(Command::Left);
 			else if(k == FL_Right)
-				set_x(cursor_x_sixel+dx);
+				run(Command::Right);
 			else if(k == FL_Up)
-				set_y(cursor_y_sixel-dy);
+				run(Command::Up);
 			else if(k == FL_Down)
-				set_y(cursor_y_sixel+dy);
+				run(Command::Down);
 			else if(k == FL_Home)
-				set_x(0);
+				run(Command::Home);
 			else if(k == FL_End)
-				set_x(80);
-			else if(k >= 32 && k <= 127 && mode == Mode::Text && (Fl::event_state()& (FL_CTRL|FL_ALT))==0)
-			{
-				crnt() = Fl::event_text()[0];
-				advance();
-			}
+				run(Command::End);
+			else if(k >= 32 && k <= 127 && mode == EditMode::Text && (Fl::event_state()& (FL_CTRL|FL_ALT))==0)
+				run(Command(Command::Put, Fl::event_text()[0]));
 			else if(k >= 32 && k <= 127 && Fl::event_state(FL_ALT) && Fl::event_state(FL_CTRL))
 			{
 				//Alt + key inserts a literal character
-				checkpoint();
-				if(Fl::event_state(FL_SHIFT))
-				{
-					if(isalpha(k))
-						k = toupper(k);
-				}
-				else
-					crnt() = k;
-				advance();
+				if(Fl::event_state(FL_SHIFT) && isalpha(k))
+					k = toupper(k);
+				run(Command(Command::Put, k));
 			}
 			else if(k == ' ') //Blank current element
-			{
-
-				if(mode == Mode::Graphics)
-				{
-					if(is_graphic())
-					{
-						checkpoint();
-						set_sixel(Set::Off);
-						set_x(cursor_x_sixel + 1);
-					}
-				}
-				else
-				{
-					checkpoint();
-					crnt() = 32;
-					advance();
-				}
-			}
-			else if(k == '.' && mode == Mode::Graphics) //Fill current sixel
-			{
-				if(is_graphic())
-				{
-					checkpoint();
-					set_sixel(Set::On);
-					set_x(cursor_x_sixel + 1);
-				}
-			}
+				run(Command::Blank);
+			else if(k == '.' && mode == EditMode::Graphics) //Fill current sixel
+				run(Command::SetSixel);
 			else if(k == 'f' && ( Fl::event_state()& (FL_SHIFT|FL_ALT|FL_CTRL))==0) //Fill block
-			{
-				checkpoint();
-				crnt() = 127;
-			}
-			else if(k == 'f' && Fl::event_state(FL_SHIFT)) //Fill block
-			{
-				if(mode == Mode::Graphics)
-				{
-					checkpoint();
-					crnt() = 32;
-				}
-			}
+				run(Command::Fill);
+			else if(k == 'f' && Fl::event_state(FL_SHIFT)) //Empty block
+				run(Command::Empty);
 			else if(k == 'n' && ( Fl::event_state()& (FL_ALT|FL_CTRL))==0)
 			{
 				//Set black/new background
-				checkpoint();
-				if(Fl::event_state(FL_SHIFT))
-					crnt() = 28;
-				else
-					crnt() = 29;
+				run(Command(Command::Code, Fl::event_state(FL_SHIFT) ? 28 : 29));
 			}
 			else if(k == 'd' && ( Fl::event_state()& (FL_ALT|FL_CTRL))==0)
 			{
 				//Set single/double height
-				checkpoint();
-				if(Fl::event_state(FL_SHIFT))
-					crnt() = 12;
-				else
-					crnt() = 13;
+				run(Command(Command::Code, Fl::event_state(FL_SHIFT) ? 12 : 13));
 			}
 			else if(k == 'z' && ( Fl::event_state()& (FL_ALT|FL_CTRL))==0)
-			{
-				crnt()=0;
-			}
+				run(Command(Command::Code, 0));
 			else if(k == 'h' && ( Fl::event_state()& (FL_ALT|FL_CTRL))==0)
 			{
 				//Release/hold graphics
-				checkpoint();
-				if(Fl::event_state(FL_SHIFT))
-					crnt() = 31;
-				else
-					crnt() = 30;
+				run(Command(Command::Code, Fl::event_state(FL_SHIFT) ? 31 : 30));
 			}
 			else if(k == 'z' && Fl::event_state(FL_CTRL))
-			{
-				undo();
-			}
+				run(Command::Undo);
 			else if(k == 'y' && Fl::event_state(FL_CTRL))
+				run(Command::Redo);
+			else if((k == 'a' || k == 'i' || k == 't' || k == 'e' || k == 'k') && mode == EditMode::Graphics && ( Fl::event_state()& (FL_ALT|FL_CTRL))==0)
 			{
-				redo();
+				//Drawing tools, from the mark to the cursor
+				const bool filled = Fl::event_state(FL_SHIFT);
+				if(k == 'a')
+					run(Command::Mark);
+				else if(k == 'i')
+					run(Command::Line);
+				else if(k == 't')
+					run(Command(Command::Rectangle, filled));
+				else if(k == 'e')
+					run(Command(Command::Ellipse, filled));
+				else
+					run(Command::FloodFill);
 			}
-			else if(k == FL_Insert && !Fl::event_state(FL_SHIFT))
+			else if((k == FL_Insert || k == FL_Delete) && Fl::event_state(FL_CTRL))
 			{
-				//Insert an element and shift thr row
-				if(mode == Mode::Graphics)
-				{
-					
-					if(is_graphic())
-					{
-						checkpoint();
-
-						int end = next_non_graphic_char();
-
-						for(int sx = end*2-2; sx >= cursor_x_sixel; sx--)
-							set_sixel(get_sixel(sx,cursor_y_sixel), sx+1, cursor_y_sixel);
-						set_sixel(Set::Off, cursor_x_sixel, cursor_y_sixel);
-					}
-				}
-				else
-				{
-					checkpoint();
-					for(int x=ren.w-2; x >= xc(); x--)
-						buffer[yc()][x+1] = buffer[yc()][x];
-					crnt() = 32;
-				}
-				
+				//Insert or delete a column of sixels
+				run(k == FL_Insert ? Command::InsertSixelColumn : Command::DeleteSixelColumn);
 			}
-			else if(k == FL_Insert && Fl::event_state(FL_SHIFT))
+			else if((k == FL_Insert || k == FL_Delete) && Fl::event_state(FL_ALT))
 			{
-				//Insert row
-				checkpoint();
-				
-				for(int y=ren.h-1; y > yc(); y--)
-					for(int x=0; x < ren.w; x++)
-						buffer[y][x] = buffer[y-1][x];
-
-				for(int x=0; x < ren.w; x++)
-					buffer[yc()][x] = 32;
+				//Insert or delete a row of sixels
+				run(k == FL_Insert ? Command::InsertSixelRow : Command::DeleteSixelRow);
 			}
-			else if(k == FL_Delete && Fl::event_state(FL_SHIFT))
+			else if(k == FL_Insert && !Fl::event_state(FL_SHIFT))
 			{
-				//Delete row
-				checkpoint();
-				
-				for(int y=yc(); y < ren.h-1; y++)
-					for(int x=0; x < ren.w; x++)
-						buffer[y][x] = buffer[y+1][x];
-
-				for(int x=0; x < ren.w; x++)
-					buffer[ren.h-1][x] = 32;
+				//Insert an element and shift the row
+				run(Command::Insert);
 			}
+			else if(k == FL_Insert && Fl::event_state(FL_SHIFT))
+				run(Command::InsertRow);
+			else if(k == FL_Delete && Fl::event_state(FL_SHIFT))
+				run(Command::DeleteRow);
 			else if(k == 'g' && Fl::event_state(FL_SHIFT))
 			{
 				//Switch between graphics mode and regular mode
-				if(mode != Mode::Graphics)
-					mode = Mode::Graphics;
+				if(mode != EditMode::Graphics)
+					run(Command(Command::SetMode, int(EditMode::Graphics)));
 				else
-					mode = Mode::Character;
-				cursor_change();
+					run(Command(Command::SetMode, int(EditMode::Character)));
 			}
 			else if(k == 'g' && Fl::event_state(FL_CTRL))
-			{
-				mode = Mode::Graphics;
-				cursor_change();
-			}
+				run(Command(Command::SetMode, int(EditMode::Graphics)));
 			else if(k == 'c' && Fl::event_state(FL_CTRL))
-			{
-				mode = Mode::Character;
-				cursor_change();
-			}
+				run(Command(Command::SetMode, int(EditMode::Character)));
 			else if(k == 't' && Fl::event_state(FL_CTRL))
-			{
-				mode = Mode::Text;
-				cursor_change();
-			}
+				run(Command(Command::SetMode, int(EditMode::Text)));
 			else if( (k == 'x' || k == FL_Delete) && ( Fl::event_state()& (FL_SHIFT|FL_ALT|FL_CTRL))==0)
-			{
-				checkpoint();
-				
-				if(mode == Mode::Graphics)
-				{
-					if(is_graphic())
-					{
-						int end = next_non_graphic_char();
-						for(int sx=cursor_x_sixel; sx < (end-1)*2+1; sx++)
-							set_sixel(get_sixel(sx+1,cursor_y_sixel), sx, cursor_y_sixel);
-						set_sixel(Set::Off, (end-1)*2+1, cursor_y_sixel);
-
-					}
-				}
-				else
-				{
-					for(int x=xc(); x < ren.w-1; x++)
-						buffer[yc()][x] = buffer[yc()][x+1];
-					buffer[yc()][ren.w-1] = 32;
-				}
-			}
+				run(Command::Delete);
 			else if((k == 'r' || k == 'g' || k == 'b' || k == 'c' || k == 'm' || k == 'y' || k == 'w') && !Fl::event_state(FL_ALT) && !Fl::event_state(FL_CTRL) &&!Fl::event_state(FL_SHIFT))
 			{
 				//Select colours.
@@ -740,46 +1027,29 @@ class MainUI: public Fl_Window
 				else if(k == 'w')
 				  	c = 7;	
 				
-				if(mode == Mode::Graphics)
-					c += 16;
-
-				checkpoint();
-				crnt()=c;
-
+				run(Command(Command::Colour, c));
 			}
 			else if( k == 'b' && Fl::event_state(FL_SHIFT))
-			{
-				checkpoint();
-				crnt() = 8;
-			}
+				run(Command(Command::Code, 8));
 			else if( k == 's' && Fl::event_state(FL_SHIFT))
-			{
-				checkpoint();
-				crnt() = 9;
-			}
+				run(Command(Command::Code, 9));
 			else if( (k == '9' || k == '0' || k == 'o' || k=='p' || k == 'l' || k == ';') && ( Fl::event_state()& (FL_SHIFT|FL_ALT|FL_CTRL))==0)
 			{
-				int c = crnt();
-				if(c & 32)
-				{
-					checkpoint();
-					if(k == '9')
-						c ^= 1;
-					else if(k == '0')
-						c ^= 2;
-					else if(k == 'o')
-						c ^= 4;
-					else if(k == 'p')
-						c ^= 8;
-					else if(k == 'l')
-						c ^= 16;
-					else if(k == ';')
-						c ^= 64;
-
-					crnt()=c;
-				}
-
-
+				int bit = 0;
+				if(k == '9')
+					bit = 1;
+				else if(k == '0')
+					bit = 2;
+				else if(k == 'o')
+					bit = 4;
+				else if(k == 'p')
+					bit = 8;
+				else if(k == 'l')
+					bit = 16;
+				else if(k == ';')
+					bit = 64;
+
+				run(Command(Command::ToggleSixels, bit));
 			}
 			else
 				return Fl_Window::handle(e);
@@ -787,83 +1057,179 @@ class MainUI: public Fl_Window
 		else
 			return Fl_Window::handle(e);
 
-		process_checkpoint();
 		return 1;
 	}
 
-
+	//Write every command from now on to a log, which ttedit can replay.
+	bool record(const string& name)
+	{
+		log_file.open(name, ios::binary);
+		log_file.write(command_log_magic, sizeof(command_log_magic));
+		session.record(&log);
+		flush_log();
+		return log_file.good();
+	}
 };
 
-void VDUDisplay::draw()
+void VDUDisplay::damage_area(const Area& a)
 {
-	const Image<Rgb<byte>>& i = ui.get_rendered_text(0);
-	
-	Image<Rgb<byte> > j = i;
+	if(a.second.area() == 0)
+		return;
+
+	pending.push_back(a);
+	damage(FL_DAMAGE_USER1, a.first.x, a.first.y, a.second.x, a.second.y);
+}
+
+void VDUDisplay::cursor_moved()
+{
+	damage_area(drawn_cursor);
+	damage_area(ui.cursor_area());
+}
+
+//Copy an area of the rendered frame and draw the overlays on it.
+void VDUDisplay::compose(const Area& a)
+{
+	TRACE_SCOPE("compose");
+	const Image<Rgb<byte>>& frame = ui.ren.get_rendered();
+	const ImageRef tl = a.first, br = a.first + a.second;
+
+	for(int y=tl.y; y < br.y; y++)
+		copy(frame[y] + tl.x, frame[y] + br.x, composed[y] + tl.x);
+
 	if(ui.cursor_blink_on)
 	{
-		ImageRef tl, size;
-		if(ui.mode == MainUI::Mode::Graphics)
-			tie(tl,size) = ui.ren.sixel_area(ui.cursor_x_sixel, ui.cursor_y_sixel);
-		else if(ui.mode == MainUI::Mode::Text)
-		{
-			tie(tl,size) = ui.ren.char_area_under_sixel(ui.cursor_x_sixel, ui.cursor_y_sixel);
-			size.x = 4;
-		}	
-		else
-			tie(tl,size) = ui.ren.char_area_under_sixel(ui.cursor_x_sixel, ui.cursor_y_sixel);
-		
-		
-		ImageRef p = tl;
+		Area c = ui.cursor_area();
+		ImageRef ctl(max(tl.x, c.first.x), max(tl.y, c.first.y));
+		ImageRef cbr(min(br.x, c.first.x + c.second.x), min(br.y, c.first.y + c.second.y));
 
-		do
-		{
-			if(p.x % 1 == 0)
+		for(int y=ctl.y; y < cbr.y; y++)
+			for(int x=ctl.x; x < cbr.x; x++)
 			{
-				j[p].red ^= 255;
-				j[p].green ^= 255;
-				j[p].blue ^= 255;
+				composed[y][x].red ^= 255;
+				composed[y][x].green ^= 255;
+				composed[y][x].blue ^= 255;
 			}
-		}
-		while(p.next(tl,tl + size));
-
 	}
 
 	if(ui.grid_toggle->value())
 	{
-		
-		ImageRef p(0,0);
-		do
+		const ImageRef g = ui.ren.glyph_size();
+		const Rgb<byte> grey(128,128,128), black(0,0,0);
+
+		for(int y=tl.y; y < br.y; y++)
 		{
-			if(p.x % ui.ren.glyph_size().x == 0)
-			{
-				if(p.x%2 == 0)
-					j[p] = Rgb<byte>(128,128,128);
-				else
-					j[p] = Rgb<byte>(0,0,0);
-			}
-			if(p.y % ui.ren.glyph_size().y == 0)
-			{
-				if(p.y%2 == 0)
-					j[p] = Rgb<byte>(128,128,128);
-				else
-					j[p] = Rgb<byte>(0,0,0);
-			}
+			if(y % g.y == 0)
+				fill(composed[y] + tl.x, composed[y] + br.x, y%2?black:grey);
+			else
+				for(int x=(tl.x + g.x - 1)/g.x*g.x; x < br.x; x += g.x)
+					composed[y][x] = x%2?black:grey;
 		}
-		while(p.next(j.size()));
 	}
+}
+
+void VDUDisplay::upload(const Area& a)
+{
+	TRACE_SCOPE("fl_draw_image");
+	fl_draw_image(reinterpret_cast<byte*>(&composed[a.first]), a.first.x, a.first.y, a.second.x, a.second.y, 3, composed.row_stride()*3);
+}
+
+void VDUDisplay::draw()
+{
+	TRACE_SCOPE("frame");
+	const Image<Rgb<byte>>& i = ui.get_rendered_text(0);
+	const Area all(ImageRef(0,0), i.size());
+	
+	//Anything other than the cursor moving means redrawing everything.
+	//That's either FLTK asking for it, or the page itself changing.
+	bool full = damage() != FL_DAMAGE_USER1 || ui.ren.repainted_rows() != 0 || i.data() != last_frame || composed.size() != i.size();
+
+	composed.resize(i.size());
+	drawn_cursor = ui.cursor_area();
+	last_frame = i.data();
+
+	if(full)
+	{
+		//The clip region may only cover the cursor, so lift it.
+		fl_push_no_clip();
+		compose(all);
+		upload(all);
+		fl_pop_clip();
+	}
+	else
+		for(const auto& a: pending)
+		{
+			compose(a);
+			upload(a);
+		}
+
+	pending.clear();
 
-	fl_draw_image((byte*)j.data(), 0, 0, j.size().x, j.size().y);
+	if(ui.timing_toggle->value())
+		draw_timing();
 }	
 
+//Percentiles of the time taken by the latest frames and renders, in a
+//strip across the top. It's drawn over whatever is there every frame,
+//so it never needs composing.
+void VDUDisplay::draw_timing()
+{
+	ostringstream text;
+	text << fixed << setprecision(2);
+
+	if(!Trace::enabled)
+		text << "Built without tracing (make TRACE=1)";
+	else
+		for(const char* name: {"frame", "render"})
+		{
+			vector<uint64_t> d = Trace::recent(name, 256);
+			text << name << " ms";
+			for(double p: {50., 90., 99.})
+				text << " p" << p << " " << Trace::percentile(d, p) / 1e6;
+			text << "   ";
+		}
+
+	fl_push_no_clip();
+	fl_color(FL_BLACK);
+	fl_rectf(0, 0, w(), 16);
+	fl_color(FL_WHITE);
+	fl_font(FL_COURIER, 12);
+	fl_draw(text.str().c_str(), 4, 12);
+	fl_pop_clip();
+}
+
 
 int main(int argc, char** argv)
 {
 	try{
 
 		MainUI m;
+		
+		int c;
+		while((c = getopt(argc, argv, "r:")) != -1)
+		{
+			if(c == 'r')
+			{
+				if(!m.record(optarg))
+				{
+					cerr << "Error opening \"" << optarg << "\": " << strerror(errno) << endl;
+					return 1;
+				}
+			}
+			else
+			{
+				cerr << "Usage: " << argv[0] << " [-r session.log] [page]\n";
+				return 1;
+			}
+		}
 			
-		if(argc >= 2)
-			m.load(argv[1]);
+		//Needed for the I/O thread to wake the UI up.
+		Fl::lock();
+		TRACE_NAME_THREAD("UI");
+
+		if(optind < argc)
+			m.load(argv[optind]);
+		else
+			m.recover_untitled();
 		
 		Fl::run();
 	}
@@ -1,35 +1,84 @@
 #include <iostream>
 #include <iomanip>
-#include <cctype>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstring>
 using namespace std;
 
+//Embeds stdin in the program as name_data, name_size and name(), which
+//returns a Resource pointing at the data (see resource.h).
+//
+//	file_to_C name < file > name.cc
+//	file_to_C -h name < file > name.h
+//
+//The data is written as a string literal, which is both much smaller
+//and much quicker to compile than a list of numbers. Printable characters
+//go in as they are and everything else as 3 digit octal escapes, so an
+//escape can never swallow the character after it.
+
 int main(int argc, char** argv)
 {
-	if(argc != 2)
+	bool header = argc == 3 && strcmp(argv[1], "-h") == 0;
+
+	if(argc != 2 && !header)
 	{
-		cerr << "Pleas supply string name\n";
+		cerr << "Usage: " << argv[0] << " [-h] name < file\n";
 		return 1;
 	}
-	
-	cout << "#include <string>\n";
-	cout << "const char* " << argv[1] << "_ = \"";
-	
-	int c;
+
+	const string name = argv[argc-1];
+	const vector<unsigned char> data{istreambuf_iterator<char>(cin), istreambuf_iterator<char>()};
+
+	cout << "//Generated by file_to_C. Do not edit.\n";
+
+	if(header)
+	{
+		cout << "#ifndef RESOURCE_" << name << "_H\n"
+		     << "#define RESOURCE_" << name << "_H\n"
+		     << "#include \"resource.h\"\n"
+		     << "\n"
+		     << "extern const unsigned char " << name << "_data[];\n"
+		     << "constexpr std::size_t " << name << "_size = " << data.size() << ";\n"
+		     << "\n"
+		     << "constexpr Resource " << name << "()\n"
+		     << "{\n"
+		     << "\treturn Resource{" << name << "_data, " << name << "_size};\n"
+		     << "}\n"
+		     << "\n"
+		     << "#endif\n";
+		return 0;
+	}
+
+	//The literal carries a terminating 0, so the array is one longer
+	//than the data.
+	cout << "#include \"" << name << ".h\"\n"
+	     << "\n"
+	     << "alignas(64) extern const unsigned char " << name << "_data[" << data.size() + 1 << "] =\n"
+	     << "\"";
+
+	const int w=100;
 	int n=0;
-	const int w=30;
-	do
+	for(unsigned char c: data)
 	{
-		c=cin.get();
-		if(!cin.good())
-			break;
-		
-		if(n % w == 0)
+		if(n >= w)
+		{
 			cout << "\"\n\"";
+			n = 0;
+		}
 
-		cout << "\\x" << hex  << c;
-		n++;
+		//? is escaped too, to stay clear of trigraphs.
+		if(c >= 32 && c < 127 && c != '"' && c != '\\' && c != '?')
+		{
+			cout << c;
+			n++;
+		}
+		else
+		{
+			cout << "\\" << oct << setw(3) << setfill('0') << int(c);
+			n += 4;
+		}
 	}
-	while(true);
-	cout << "\";\n" << dec << setw(0) << setfill(' ');
-	cout << "const std::string " <<  argv[1] << "() { return std::string(" << argv[1] << "_, " << n << ");}\n";
+
+	cout << "\";\n";
 }
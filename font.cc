@@ -0,0 +1,160 @@
+#include "font.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+	//A glyph at the scaled size, one bit per pixel, 48 pixels at most.
+	typedef uint64_t Wide;
+
+	bool pixel(const FontSet::Row* g, int x, int y)
+	{
+		if(x < 0 || y < 0 || x >= FontSet::glyph_w || y >= FontSet::glyph_h)
+			return false;
+		return (g[y] >> x) & 1;
+	}
+
+	//Each pixel becomes an s by s block. With rounding, a clear pixel
+	//gets a corner cut in wherever it sits in the crook of a diagonal
+	//step, i.e. its neighbours either side of the corner are set. It's
+	//left alone if both of those carry on past it, since then it's a
+	//proper right angle, not a step.
+	void scale_glyph(const FontSet::Row* in, int s, bool rounding, Wide* out)
+	{
+		const Wide block = (Wide(1) << s) - 1;
+
+		for(int y=0; y < FontSet::glyph_h; y++)
+		{
+			Wide row=0;
+			for(int x=0; x < FontSet::glyph_w; x++)
+				if(pixel(in, x, y))
+					row |= block << (x*s);
+
+			for(int j=0; j < s; j++)
+				out[y*s + j] = row;
+		}
+
+		if(!rounding)
+			return;
+
+		for(int y=0; y < FontSet::glyph_h; y++)
+			for(int x=0; x < FontSet::glyph_w; x++)
+			{
+				if(pixel(in, x, y))
+					continue;
+
+				for(int dy=-1; dy <= 1; dy+=2)
+					for(int dx=-1; dx <= 1; dx+=2)
+					{
+						if(!pixel(in, x+dx, y) || !pixel(in, x, y+dy))
+							continue;
+						if(pixel(in, x-dx, y+dy) && pixel(in, x+dx, y-dy))
+							continue;
+
+						//Fill the triangle in the corner, up to half way
+						//along each side.
+						for(int j=0; j < s; j++)
+							for(int i=0; i < s; i++)
+							{
+								int u = dx < 0 ? i : s-1-i;
+								int v = dy < 0 ? j : s-1-j;
+								if(2*(u+v) < s)
+									out[y*s + j] |= Wide(1) << (x*s + i);
+							}
+					}
+			}
+	}
+
+	//Cut a scaled glyph into 12 pixel wide strips.
+	void split(const Wide* in, int s, FontSet::Row* out)
+	{
+		const int rows = FontSet::glyph_h * s;
+		for(int k=0; k < s; k++)
+			for(int y=0; y < rows; y++)
+				out[k*rows + y] = (in[y] >> (k*FontSet::glyph_w)) & FontSet::row_mask;
+	}
+}
+
+FontSet::FontSet(int scale, bool rounding)
+:s(scale)
+{
+	if(s < 1 || s > max_scale)
+		throw invalid_argument("Font scale must be from 1 to 4");
+
+	//At the native size, the built in table has exactly the right layout.
+	if(s == 1)
+	{
+		glyphs[Standard] = &table.glyphs[0][0][0];
+		glyphs[Upper] = &table.upper[0][0][0];
+		glyphs[Lower] = &table.lower[0][0][0];
+		control = &table.control[0][0];
+		blank = table.blank;
+		return;
+	}
+
+	const int n = glyph_rows();
+	const int glyphs_n = (128-first_glyph)*3;
+	scaled.assign((3*glyphs_n + 32 + 1) * n, 0);
+
+	Row* plane[3];
+	plane[Standard] = &scaled[0];
+	plane[Upper] = &scaled[glyphs_n*n];
+	plane[Lower] = &scaled[2*glyphs_n*n];
+
+	Wide big[glyph_h * max_scale];
+	Wide tall[glyph_h * max_scale];
+
+	for(int i=0; i < 128-first_glyph; i++)
+		for(int m=Normal; m <= ThinGraphics; m++)
+		{
+			//Separated and contiguous graphics are blocks, so only text
+			//is rounded.
+			bool text = m == Normal || !((i+first_glyph) & 32);
+			scale_glyph(table.glyphs[i][m], s, rounding && text, big);
+
+			const int g = (i*3 + m) * n;
+			split(big, s, plane[Standard] + g);
+
+			//Double height is the top and bottom halves of the scaled glyph,
+			//stretched, so the rounding is stretched along with it.
+			const int rows = glyph_h * s;
+			for(int y=0; y < rows; y++)
+				tall[y] = big[y/2];
+			split(tall, s, plane[Upper] + g);
+
+			for(int y=0; y < rows; y++)
+				tall[y] = big[rows/2 + y/2];
+			split(tall, s, plane[Lower] + g);
+		}
+
+	Row* c = &scaled[3*glyphs_n*n];
+	for(int i=0; i < 32; i++)
+	{
+		scale_glyph(table.control[i], s, false, big);
+		split(big, s, c + i*n);
+	}
+
+	for(int h=Standard; h <= Lower; h++)
+		glyphs[h] = plane[h];
+	control = c;
+	blank = control + 32 * n;
+}
+
+const FontSet& FontSet::get(int scale, bool rounding)
+{
+	if(scale < 1 || scale > max_scale)
+		throw invalid_argument("Font scale must be from 1 to 4");
+
+	static mutex m;
+	static unique_ptr<FontSet> fonts[max_scale+1][2];
+
+	lock_guard<mutex> lock(m);
+	unique_ptr<FontSet>& f = fonts[scale][rounding && scale > 1];
+	if(!f)
+		f.reset(new FontSet(scale, rounding));
+	return *f;
+}
@@ -0,0 +1,120 @@
+#ifndef FONT_H_q8Xv2mRkT4wNcb
+#define FONT_H_q8Xv2mRkT4wNcb
+#include <cvd/image_ref.h>
+#include <cstdint>
+#include <vector>
+
+//The teletext character set, as row masks ready for blitting.
+class FontSet
+{
+	public:
+
+	//Each glyph row is a bitmask, with the leftmost pixel in bit 0.
+	//Glyphs are 12 pixels wide, so a row fits in 16 bits.
+	typedef uint16_t Row;
+
+	static const int glyph_w=12;
+	static const int glyph_h=18;
+	static const Row row_mask = (1<<glyph_w)-1;
+
+	enum Mode
+	{
+		Normal,
+		Graphics,
+		ThinGraphics
+	};
+	
+	enum Height
+	{
+		Standard,
+		Upper,
+		Lower
+	};
+
+	//Codes below 32 never reach the glyph lookup (they are replaced with
+	//a blank or a held graphic), so the table starts at 32. The whole
+	//thing is a single block of about 32K, rather than 1000+ separately
+	//allocated images. Everything a page without double height text
+	//needs is in the first 11K; the upper and lower halves of double
+	//height glyphs follow in blocks of their own.
+	static const int first_glyph=32;
+
+	struct alignas(64) Table
+	{
+		Row glyphs[128-first_glyph][3][glyph_h];
+		Row control[32][glyph_h];
+		Row blank[glyph_h];
+		Row upper[128-first_glyph][3][glyph_h];
+		Row lower[128-first_glyph][3][glyph_h];
+	};
+
+	static const int max_scale=4;
+
+	private:
+
+	//Unpacked from the font and control code bitmaps at build time by
+	//make_font (see font_table.cc), so there's nothing to do at startup.
+	static const Table table;
+
+	//Scaled glyphs are laid out like the table, but each glyph is scale
+	//strips of glyph_h*scale rows, each strip 12 pixels across. That way
+	//every strip is blitted exactly like a glyph at the native size.
+	//
+	//Each height is a separate block, so a page without double height
+	//text only ever touches the standard height glyphs.
+	int s;
+	std::vector<Row> scaled;
+	const Row* glyphs[3];
+	const Row* control;
+	const Row* blank;
+
+	int glyph_rows() const
+	{
+		return glyph_h * s * s;
+	}
+
+	public:
+
+	//Glyphs scaled up by 1 to max_scale. With rounding, diagonals in text
+	//are smoothed on the finer grid, much as the SAA5050 rounds its 5x9
+	//font when doubling it up to 10x18.
+	FontSet(int scale=1, bool rounding=false);
+
+	//The same, built on first use and then shared by the whole process.
+	//Fonts are never changed once built, so they can be used from any
+	//number of threads at once.
+	static const FontSet& get(int scale=1, bool rounding=false);
+
+	FontSet(const FontSet&) = delete;
+	FontSet& operator=(const FontSet&) = delete;
+
+	int scale() const
+	{
+		return s;
+	}
+
+	CVD::ImageRef size() const
+	{
+		return CVD::ImageRef(glyph_w*s, glyph_h*s);
+	}
+
+	//Returns scale() strips of size().y rows, left to right.
+	const Row* get_glyph(int i, Mode m, Height h) const
+	{
+		if(i < first_glyph)
+			return blank;
+		return glyphs[h] + ((i-first_glyph)*3 + m) * glyph_rows();
+	}
+
+	const Row* get_control_glyph(int i) const
+	{
+		return control + i * glyph_rows();
+	}
+
+	const Row* get_blank() const
+	{
+		return blank;
+	}
+};
+
+#endif
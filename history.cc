@@ -0,0 +1,204 @@
+#include "history.h"
+#include "trace.h"
+#include <algorithm>
+
+using namespace std;
+using namespace CVD;
+
+History::History(size_t memory_budget, int snapshot_every)
+:budget(memory_budget),
+ snapshot_interval(snapshot_every)
+{}
+
+size_t History::step_size(const Step& s) const
+{
+	return sizeof(Step) + s.changes.capacity() * sizeof(Change) + (s.snapshot ? before.size().area() : 0);
+}
+
+void History::apply(Image<byte>& page, const Step& s, bool forwards) const
+{
+	byte* p = page.data();
+	if(forwards)
+		for(const auto& c: s.changes)
+			p[c.index] = c.after;
+	else
+		for(const auto& c: s.changes)
+			p[c.index] = c.before;
+}
+
+void History::checkpoint(const Image<byte>& page)
+{
+	if(pending)
+		return;
+
+	TRACE_SCOPE("checkpoint");
+
+	before.copy_from(page);
+	pending=true;
+}
+
+bool History::commit(const Image<byte>& page)
+{
+	if(!pending)
+		return false;
+
+	TRACE_SCOPE("commit");
+	pending=false;
+
+	Step s;
+	const byte* b = before.data();
+	const byte* a = page.data();
+	const int n = page.size().area();
+
+	int count=0;
+	for(int i=0; i < n; i++)
+		count += b[i] != a[i];
+
+	if(count == 0)
+		return false;
+
+	s.changes.reserve(count);
+	for(int i=0; i < n; i++)
+		if(b[i] != a[i])
+			s.changes.push_back(Change{static_cast<uint16_t>(i), b[i], a[i]});
+
+	if(++steps_since_snapshot >= snapshot_interval)
+	{
+		s.snapshot.reset(new byte[n]);
+		copy(a, a+n, s.snapshot.get());
+		steps_since_snapshot=0;
+	}
+
+	for(const auto& r: redos)
+		used -= step_size(r);
+	redos.clear();
+
+	used += step_size(s);
+	undos.push_back(move(s));
+
+	enforce_budget();
+	return true;
+}
+
+//Drop the oldest history (and failing that, the furthest redo) until
+//the history fits.
+void History::enforce_budget()
+{
+	while(used > budget && !undos.empty())
+	{
+		used -= step_size(undos.front());
+		undos.pop_front();
+	}
+
+	while(used > budget && !redos.empty())
+	{
+		used -= step_size(redos.front());
+		redos.pop_front();
+	}
+}
+
+void History::set_memory_budget(size_t b)
+{
+	budget = b;
+	enforce_budget();
+}
+
+//Going back k steps lands on the page as it was after step n-k-1. That
+//can be reached either by undoing each step in turn, or by starting
+//from a later snapshot and undoing from there, whichever touches fewer
+//bytes.
+bool History::undo(Image<byte>& page, int steps)
+{
+	const int n = undos.size();
+	const int k = min(steps, n);
+	if(k <= 0)
+		return false;
+
+	const int target = n - k - 1;
+
+	size_t replay=0;
+	for(int i=target+1; i < n; i++)
+		replay += undos[i].changes.size();
+
+	//There's no snapshot of the page before the oldest step.
+	int snap=-1;
+	size_t from_snap=page.size().area();
+	if(target >= 0)
+		for(int i=target; i < n; i++)
+		{
+			if(i > target)
+				from_snap += undos[i].changes.size();
+			if(undos[i].snapshot)
+			{
+				snap = i;
+				break;
+			}
+		}
+
+	int start = n-1;
+	if(snap != -1 && from_snap < replay)
+	{
+		const byte* s = undos[snap].snapshot.get();
+		copy(s, s + page.size().area(), page.data());
+		start = snap;
+	}
+
+	for(int i=start; i > target; i--)
+		apply(page, undos[i], false);
+
+	for(int i=0; i < k; i++)
+	{
+		redos.push_back(move(undos.back()));
+		undos.pop_back();
+	}
+
+	return true;
+}
+
+//The mirror image of undo. Redoing k steps lands on the page as it was
+//after redos[m-k]. A snapshot on that step, or one shortly before it,
+//saves replaying the steps in between.
+bool History::redo(Image<byte>& page, int steps)
+{
+	const int m = redos.size();
+	const int k = min(steps, m);
+	if(k <= 0)
+		return false;
+
+	const int target = m - k;
+
+	size_t replay=0;
+	for(int i=target; i < m; i++)
+		replay += redos[i].changes.size();
+
+	int snap=-1;
+	size_t from_snap=page.size().area();
+	for(int i=target; i < m; i++)
+	{
+		if(redos[i].snapshot)
+		{
+			snap = i;
+			break;
+		}
+		from_snap += redos[i].changes.size();
+	}
+
+	int start = m-1;
+	if(snap != -1 && from_snap < replay)
+	{
+		const byte* s = redos[snap].snapshot.get();
+		copy(s, s + page.size().area(), page.data());
+		start = snap-1;
+	}
+
+	for(int i=start; i >= target; i--)
+		apply(page, redos[i], true);
+
+	for(int i=0; i < k; i++)
+	{
+		undos.push_back(move(redos.back()));
+		redos.pop_back();
+	}
+
+	return true;
+}
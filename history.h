@@ -0,0 +1,92 @@
+#ifndef HISTORY_H_p4RkWm9cXe2TzA
+#define HISTORY_H_p4RkWm9cXe2TzA
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <memory>
+
+//Undo/redo history for a page.
+//
+//Each step is stored as the list of bytes which changed (with their
+//old and new values), rather than a copy of the page. Every so often a
+//step also keeps a full copy of the page after it, so that going back
+//a long way doesn't mean replaying every step in between. When the
+//history goes over its memory budget, the oldest steps are dropped.
+class History
+{
+	public:
+
+	struct Change
+	{
+		uint16_t index;
+		CVD::byte before, after;
+	};
+
+	private:
+
+	struct Step
+	{
+		std::vector<Change> changes;
+
+		//The page after this step, if this step has a snapshot.
+		std::unique_ptr<CVD::byte[]> snapshot;
+	};
+
+	//Oldest at the front. The next step to redo is at the back of redos.
+	std::deque<Step> undos, redos;
+
+	CVD::Image<CVD::byte> before;
+	bool pending=false;
+	size_t budget;
+	int snapshot_interval;
+	int steps_since_snapshot=0;
+	size_t used=0;
+
+	size_t step_size(const Step& s) const;
+	void apply(CVD::Image<CVD::byte>& page, const Step& s, bool forwards) const;
+	void enforce_budget();
+
+	public:
+
+	History(size_t memory_budget=1<<20, int snapshot_every=64);
+
+	//Record the page before an edit. Repeated calls before commit() are
+	//ignored, so an edit can checkpoint as often as it likes.
+	void checkpoint(const CVD::Image<CVD::byte>& page);
+
+	//Finish the edit started by checkpoint(). Returns false (and records
+	//nothing) if the page didn't actually change.
+	bool commit(const CVD::Image<CVD::byte>& page);
+
+	//Move back or forward by the given number of steps. Returns false if
+	//there was nothing to undo/redo.
+	bool undo(CVD::Image<CVD::byte>& page, int steps=1);
+	bool redo(CVD::Image<CVD::byte>& page, int steps=1);
+
+	size_t undo_steps() const
+	{
+		return undos.size();
+	}
+
+	size_t redo_steps() const
+	{
+		return redos.size();
+	}
+
+	//Approximate memory used by the stored steps, in bytes.
+	size_t memory_used() const
+	{
+		return used;
+	}
+
+	size_t memory_budget() const
+	{
+		return budget;
+	}
+
+	void set_memory_budget(size_t b);
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <cvd/image.h>
+#include <cvd/image_io.h>
+#include <cvd/exceptions.h>
+
+#include "font.h"
+
+using namespace std;
+using namespace CVD;
+
+//Unpacks the font and the control code bitmaps into the tables used by
+//FontSet and writes them out as C++, so that none of this happens at
+//run time.
+//
+//Usage: cat control_code_pgms | make_font teletext.fnt > font_table.cc
+
+typedef FontSet::Row Row;
+static const int glyph_w = FontSet::glyph_w;
+static const int glyph_h = FontSet::glyph_h;
+static const Row row_mask = FontSet::row_mask;
+
+static void unpack(FontSet::Table& t, istream& controls, istream& fi)
+{
+	fill(begin(t.blank), end(t.blank), 0);
+
+	for(int i=0; i < 32; i++)
+	{
+		Image<bool> g = img_load(controls);
+		for(int y=0; y < glyph_h; y++)
+		{
+			t.control[i][y] = 0;
+			for(int x=0; x < glyph_w; x++)
+				t.control[i][y] |= g[y][x] << x;
+		}
+	}
+
+	//Teletext has 5 character sets:
+	//Normal
+	//Double height upper
+	//Double height lower
+	//Contig Block graphics
+	//Noncontig block graphics
+
+	//0 to 31 are control codes
+	//32 to 127 are graphics codes
+
+	//Teletext is 7 bit, so these are repeated.
+
+	//The BBC terminal driver intercepts 0-31 and 127 as
+	//terminal driver control codes, but not if the high bit is
+	//set. This is not the case if screen memory is written directly.
+		
+	//In fact, the BBC terminal driver gently mangles a number of
+	//things below 128, including the british pound and # signs.
+	
+	//This class reflects true telext (i.e. what the SAA chip does
+	//if youwrite to screen memory).
+
+	//Teletext font in file is is 10x18 (?)
+	//Packed as 16x18
+
+	//2x3 subpixel sizes
+	const int sx = glyph_w/2;
+	const int sy = glyph_h/3;
+	const Row left = (1<<sx)-1;
+	const Row right = row_mask & ~left;
+
+	for(int i=32; i <= 127; i++)
+	{
+		Row out[glyph_h];
+
+		for(int y=0; y < glyph_h; y++)
+		{
+			unsigned char c = fi.get(); //Second bits
+			unsigned char d = fi.get(); //First bits
+
+			out[y] = ((d>>1)&1) | ((d&1) << 1);
+			for(int b=0; b < 8; b++)
+				out[y] |= ((c >> (7-b))&1) << (2+b);
+		}
+		
+		Row (&g)[3][glyph_h] = t.glyphs[i-FontSet::first_glyph];
+
+		//Graphics blocks have bit 5 set...
+		//Without bit 5, it reverts to normal characters.
+		if(i & 32 )
+		{
+			//Bits for the left and right sixel in each of the three rows
+			const int sixels[3][2] = {{1, 2}, {4, 8}, {16, 64}};
+			
+			for(int y=0; y < glyph_h; y++)
+			{
+				const int* s = sixels[y/sy];
+				Row graphics = ((i&s[0])?left:0) | ((i&s[1])?right:0);
+
+				//Cut out the lines to thin down the graphics
+				Row thingraphics = 0;
+				if(y%sy != 0)
+					thingraphics = graphics & ~(1 | (1<<sx));
+
+				g[FontSet::Normal][y] = out[y];
+				g[FontSet::Graphics][y] = graphics;
+				g[FontSet::ThinGraphics][y] = thingraphics;
+			}
+		}
+		else
+		{
+			for(int y=0; y < glyph_h; y++)
+				g[FontSet::Normal][y] = g[FontSet::Graphics][y] = g[FontSet::ThinGraphics][y] = out[y];
+		}
+
+		//Double height glyphs are the top and bottom halves, stretched
+		for(int m=FontSet::Normal; m <= FontSet::ThinGraphics; m++)
+			for(int y=0; y < glyph_h; y++)
+			{
+				t.upper[i-FontSet::first_glyph][m][y] = g[m][y/2];
+				t.lower[i-FontSet::first_glyph][m][y] = g[m][glyph_h/2 + y/2];
+			}
+	}
+}
+
+static void print_rows(const Row* r, const string& indent, const string& comment)
+{
+	cout << indent << "{";
+	for(int y=0; y < glyph_h; y++)
+		cout << (y?",":"") << "0x" << hex << setw(3) << setfill('0') << r[y];
+	cout << "}, //" << comment << "\n";
+}
+
+static void print_glyphs(const Row (&g)[128-FontSet::first_glyph][3][glyph_h], const string& comment)
+{
+	const char* modes[] = {"normal", "graphics", "thin graphics"};
+
+	cout << "{ //" << comment << "\n";
+	for(int i=0; i < 128-FontSet::first_glyph; i++)
+	{
+		cout << "\t{ //" << dec << i + FontSet::first_glyph << "\n";
+		for(int m=0; m < 3; m++)
+			print_rows(g[i][m], "\t\t", modes[m]);
+		cout << "\t},\n";
+	}
+	cout << "},\n";
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2)
+	{
+		cerr << "Usage: " << argv[0] << " teletext.fnt < control_code_pgms > font_table.cc\n";
+		return 1;
+	}
+
+	ifstream fi(argv[1]);
+	static FontSet::Table t;
+
+	try
+	{
+		unpack(t, cin, fi);
+	}
+	catch(Exceptions::All& e)
+	{
+		cerr << "Error reading control code images: " << e.what() << endl;
+		return 1;
+	}
+
+	if(!fi.good())
+	{
+		cerr << "Error reading font from \"" << argv[1] << "\"\n";
+		return 1;
+	}
+
+	cout << "//Generated by make_font from " << argv[1] << " and the control code bitmaps. Do not edit.\n"
+	     << "#include \"font.h\"\n"
+	     << "\n"
+	     << "constexpr FontSet::Table FontSet::table = {\n";
+
+	print_glyphs(t.glyphs, "standard height");
+
+	cout << "{\n";
+	for(int i=0; i < 32; i++)
+	{
+		ostringstream comment;
+		comment << "control code " << i;
+		print_rows(t.control[i], "\t", comment.str());
+	}
+
+	cout << "},\n";
+	print_rows(t.blank, "", "blank");
+	print_glyphs(t.upper, "double height upper");
+	print_glyphs(t.lower, "double height lower");
+	cout << "};\n";
+}
@@ -0,0 +1,231 @@
+#include "mosaic.h"
+#include "render.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <climits>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+using namespace CVD;
+
+namespace
+{
+	const int w = Renderer::w;
+	const int sw = w*2, sh = Renderer::h*3;
+
+	//The picture averaged down to one colour per sixel.
+	struct Samples
+	{
+		float rgb[sh][sw][3];
+	};
+
+	void sample(const BasicImage<Rgb<byte>>& pic, Samples& s)
+	{
+		const ImageRef size = pic.size();
+
+		for(int y=0; y < sh; y++)
+		{
+			int y0 = y * size.y / sh, y1 = max(y0+1, (y+1) * size.y / sh);
+
+			for(int x=0; x < sw; x++)
+			{
+				int x0 = x * size.x / sw, x1 = max(x0+1, (x+1) * size.x / sw);
+				double sum[3]={0,0,0};
+
+				for(int yy=y0; yy < y1; yy++)
+					for(int xx=x0; xx < x1; xx++)
+					{
+						sum[0] += pic[yy][xx].red;
+						sum[1] += pic[yy][xx].green;
+						sum[2] += pic[yy][xx].blue;
+					}
+
+				for(int i=0; i < 3; i++)
+					s.rgb[y][x][i] = sum[i] / ((x1-x0)*(y1-y0));
+			}
+		}
+	}
+
+	//Sixel i of a cell is bit i of a 6 bit pattern, top left to bottom
+	//right. The code for the pattern puts the last one in bit 6.
+	int graphic_code(int pattern)
+	{
+		return 32 | (pattern & 31) | ((pattern & 32) << 1);
+	}
+
+	//The state carried along a row, as an index.
+	struct State
+	{
+		int on, fg, bg, hold, held;
+
+		static const int count = 2*8*8*2*64;
+
+		int index() const
+		{
+			return (((on*8 + fg)*8 + bg)*2 + hold)*64 + held;
+		}
+
+		static State from(int i)
+		{
+			State s;
+			s.held = i % 64; i /= 64;
+			s.hold = i % 2; i /= 2;
+			s.bg = i % 8; i /= 8;
+			s.fg = i % 8; i /= 8;
+			s.on = i;
+			return s;
+		}
+	};
+
+	void convert_row(const Samples& samples, int y, BasicImage<byte>& page)
+	{
+		//Error of each sixel of each cell against each colour
+		int err[w][6][8];
+		for(int x=0; x < w; x++)
+			for(int i=0; i < 6; i++)
+			{
+				const float* p = samples.rgb[y*3 + i/2][x*2 + i%2];
+				for(int c=0; c < 8; c++)
+				{
+					Rgb<byte> col = Renderer::colour(c);
+					float d[3] = {p[0] - col.red, p[1] - col.green, p[2] - col.blue};
+					err[x][i][c] = int(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+				}
+			}
+
+		auto cost = [&](int x, int pattern, int fg, int bg)
+		{
+			int e=0;
+			for(int i=0; i < 6; i++)
+				e += err[x][i][(pattern >> i) & 1 ? fg : bg];
+			return e;
+		};
+
+		auto best_pattern = [&](int x, int fg, int bg)
+		{
+			int p=0;
+			for(int i=0; i < 6; i++)
+				if(err[x][i][fg] < err[x][i][bg])
+					p |= 1 << i;
+			return p;
+		};
+
+		const int inf = INT_MAX;
+		vector<int> here(State::count, inf), next(State::count);
+
+		//How each state was reached, for going back along the row.
+		vector<uint16_t> from(w * State::count);
+		vector<byte> code(w * State::count);
+
+		//Rows start with white text on black.
+		here[State{0, 7, 0, 0, 0}.index()] = 0;
+
+		for(int x=0; x < w; x++)
+		{
+			fill(next.begin(), next.end(), inf);
+
+			auto relax = [&](int s, const State& t, int c, int e)
+			{
+				int i = t.index();
+				if(e < next[i])
+				{
+					next[i] = e;
+					from[x*State::count + i] = s;
+					code[x*State::count + i] = c;
+				}
+			};
+
+			for(int s=0; s < State::count; s++)
+			{
+				if(here[s] == inf)
+					continue;
+
+				const State st = State::from(s);
+
+				//A graphic.
+				if(st.on)
+				{
+					int p = best_pattern(x, st.fg, st.bg);
+					State t = st;
+					t.held = p;
+					relax(s, t, graphic_code(p), here[s] + cost(x, p, st.fg, st.bg));
+				}
+
+				//A control code, which shows as a space, or the held
+				//graphic, in the colours it sets.
+				auto control = [&](int c, State t)
+				{
+					int p = t.hold && t.on ? t.held : 0;
+					relax(s, t, c, here[s] + cost(x, p, t.fg, t.bg));
+				};
+
+				for(int c=1; c < 8; c++)
+				{
+					State t = st;
+					t.on = 1;
+					t.fg = c;
+					control(16 + c, t);
+				}
+
+				State t = st;
+				t.bg = 0;
+				control(28, t);
+
+				t = st;
+				t.bg = st.fg;
+				control(29, t);
+
+				t = st;
+				t.hold = 1;
+				control(30, t);
+
+				t = st;
+				t.hold = 0;
+				control(31, t);
+			}
+
+			swap(here, next);
+		}
+
+		int s = min_element(here.begin(), here.end()) - here.begin();
+		for(int x=w-1; x >= 0; x--)
+		{
+			page[y][x] = code[x*State::count + s];
+			s = from[x*State::count + s];
+		}
+	}
+}
+
+void picture_to_mosaic(const BasicImage<Rgb<byte>>& picture, BasicImage<byte>& page, unsigned int threads)
+{
+	if(page.size() != ImageRef(Renderer::w, Renderer::h))
+		throw invalid_argument("Pages must be 40x25");
+	if(picture.size().x < 1 || picture.size().y < 1)
+		throw invalid_argument("Empty picture");
+
+	unique_ptr<Samples> samples(new Samples);
+	sample(picture, *samples);
+
+	if(threads == 0)
+		threads = max(1u, thread::hardware_concurrency());
+	threads = min(threads, unsigned(Renderer::h));
+
+	atomic<int> next_row(0);
+	auto work = [&]()
+	{
+		for(int y; (y = next_row++) < Renderer::h; )
+			convert_row(*samples, y, page);
+	};
+
+	vector<thread> workers;
+	for(unsigned int i=1; i < threads; i++)
+		workers.emplace_back(work);
+	work();
+
+	for(auto& t: workers)
+		t.join();
+}
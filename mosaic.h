@@ -0,0 +1,21 @@
+#ifndef MOSAIC_H_Jf3xP9wTq6LmNc
+#define MOSAIC_H_Jf3xP9wTq6LmNc
+#include <cvd/image.h>
+#include <cvd/rgb.h>
+#include <cvd/byte.h>
+
+//Turns a picture into a page of block graphics.
+//
+//The picture is stretched over the page and averaged down to one colour
+//per sixel. Each row is then worked out separately, by dynamic
+//programming over everything which carries along a row in the renderer
+//(graphics on, foreground, background, hold and the held graphic). Every
+//cell is either a graphic, with each sixel whichever of the foreground
+//and background is closer, or a control code. The row with the least
+//squared error against the picture, in RGB, wins.
+//
+//Rows are independent, so they are shared between threads (0 means
+//all cores).
+void picture_to_mosaic(const CVD::BasicImage<CVD::Rgb<CVD::byte>>& picture, CVD::BasicImage<CVD::byte>& page, unsigned int threads=0);
+
+#endif
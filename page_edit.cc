@@ -0,0 +1,87 @@
+#include "page_edit.h"
+#include "sixel_plane.h"
+#include <algorithm>
+
+using namespace std;
+using namespace CVD;
+
+static int sixel_mask(int x, int y)
+{
+	int o = x%2 + 2 *(y%3);
+	//But bits go 1,2,4,8,16, 64
+	if(o ==5)
+		o = 6;
+
+	return 1 << o;
+}
+
+bool get_sixel(const BasicImage<byte>& page, int x, int y)
+{
+	return page[y/3][x/2] & sixel_mask(x, y);
+}
+
+void set_sixel(BasicImage<byte>& page, Set way, int x, int y)
+{
+	int mask = sixel_mask(x, y);
+
+	if(way == Set::On)
+		page[y/3][x/2] |= mask;
+	else if(way == Set::Off)
+		page[y/3][x/2] &= ~mask;
+	else if(way == Set::Toggle)
+		page[y/3][x/2] ^= mask;
+}
+
+int next_non_graphic_char(const BasicImage<byte>& page, int x, int y)
+{
+	int end=x;
+	for(; end < page.size().x; end++)
+		if(!(page[y][end] & 32))
+			break;
+	return end;
+}
+
+//The whole sixel row is shifted in one go, and written back.
+void insert_sixel(BasicImage<byte>& page, int x, int y)
+{
+	SixelRow r = read_sixel_row(page, y);
+	r.shift_right(x, next_non_graphic_char(page, x/2, y/3) * 2);
+	write_sixel_row(page, y, r);
+}
+
+void delete_sixel(BasicImage<byte>& page, int x, int y)
+{
+	SixelRow r = read_sixel_row(page, y);
+	r.shift_left(x, next_non_graphic_char(page, x/2, y/3) * 2);
+	write_sixel_row(page, y, r);
+}
+
+void insert_char(BasicImage<byte>& page, int x, int y)
+{
+	byte* row = page[y];
+	copy_backward(row + x, row + page.size().x - 1, row + page.size().x);
+	row[x] = ' ';
+}
+
+void delete_char(BasicImage<byte>& page, int x, int y)
+{
+	byte* row = page[y];
+	copy(row + x + 1, row + page.size().x, row + x);
+	row[page.size().x-1] = ' ';
+}
+
+void insert_row(BasicImage<byte>& page, int y)
+{
+	for(int r=page.size().y-1; r > y; r--)
+		copy(page[r-1], page[r-1] + page.size().x, page[r]);
+
+	fill(page[y], page[y] + page.size().x, ' ');
+}
+
+void delete_row(BasicImage<byte>& page, int y)
+{
+	for(int r=y; r < page.size().y-1; r++)
+		copy(page[r+1], page[r+1] + page.size().x, page[r]);
+
+	fill(page[page.size().y-1], page[page.size().y-1] + page.size().x, ' ');
+}
@@ -0,0 +1,44 @@
+#ifndef PAGE_EDIT_H_Lr3wQe8ZpK2mVd
+#define PAGE_EDIT_H_Lr3wQe8ZpK2mVd
+#include <cvd/image.h>
+#include <cvd/byte.h>
+
+//Edits to a 40x25 page of teletext codes, shared by the editor and
+//the tools.
+//
+//Sixels are addressed on the 80x75 grid, two across and three down
+//per cell. Sixel operations only make sense on cells holding graphics
+//characters (bit 5 set).
+
+enum class Set
+{
+	Off = 0,
+	On  = 1,
+	Toggle = 2
+};
+
+bool get_sixel(const CVD::BasicImage<CVD::byte>& page, int x, int y);
+void set_sixel(CVD::BasicImage<CVD::byte>& page, Set way, int x, int y);
+
+//The first cell at or after x on row y which isn't a graphics character,
+//or the page width if there isn't one.
+int next_non_graphic_char(const CVD::BasicImage<CVD::byte>& page, int x, int y);
+
+//Shift the sixels from (x, y) up to the next non graphics character
+//right by one, leaving (x, y) clear.
+void insert_sixel(CVD::BasicImage<CVD::byte>& page, int x, int y);
+
+//Shift the sixels after (x, y) up to the next non graphics character
+//left by one, clearing the last one.
+void delete_sixel(CVD::BasicImage<CVD::byte>& page, int x, int y);
+
+//Insert or delete a cell, shifting the rest of the row along and
+//filling with a space.
+void insert_char(CVD::BasicImage<CVD::byte>& page, int x, int y);
+void delete_char(CVD::BasicImage<CVD::byte>& page, int x, int y);
+
+//Insert or delete a row, shifting the rows below and filling with spaces.
+void insert_row(CVD::BasicImage<CVD::byte>& page, int y);
+void delete_row(CVD::BasicImage<CVD::byte>& page, int y);
+
+#endif
@@ -0,0 +1,282 @@
+#include "page_io.h"
+#include "archive.h"
+#include "trace.h"
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <sstream>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace CVD;
+
+static const char autosave_magic[8] = {'T','T','X','A','U','T','O','1'};
+
+static string error_text(const string& what, const string& name)
+{
+	return what + " \"" + name + "\": " + strerror(errno);
+}
+
+static void write_all(int fd, const void* data, size_t n, const string& name)
+{
+	const char* p = static_cast<const char*>(data);
+	while(n > 0)
+	{
+		ssize_t w = write(fd, p, n);
+		if(w < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw PageIOError(error_text("Error writing to", name));
+		}
+		p += w;
+		n -= w;
+	}
+}
+
+//The rename itself is only durable once the directory is synced.
+static void sync_directory(const string& name)
+{
+	size_t slash = name.rfind('/');
+	string dir = slash == string::npos ? "." : slash == 0 ? "/" : name.substr(0, slash);
+
+	int fd = open(dir.c_str(), O_RDONLY);
+	if(fd == -1)
+		return;
+	fsync(fd);
+	close(fd);
+}
+
+void replace_file(const string& name, const void* data, size_t size)
+{
+	replace_file(name, [&](const string& tmp)
+	{
+		int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if(fd == -1)
+			throw PageIOError(error_text("Error creating", tmp));
+
+		try
+		{
+			write_all(fd, data, size, tmp);
+		}
+		catch(...)
+		{
+			close(fd);
+			throw;
+		}
+
+		if(close(fd) == -1)
+			throw PageIOError(error_text("Error writing to", tmp));
+	});
+}
+
+void replace_file(const string& name, const function<void(const string&)>& write)
+{
+	const string tmp = name + "." + to_string(getpid()) + ".tmp";
+	int fd = -1;
+
+	try
+	{
+		write(tmp);
+
+		fd = open(tmp.c_str(), O_RDWR);
+		if(fd == -1)
+			throw PageIOError(error_text("Error opening", tmp));
+
+		struct stat s;
+		if(stat(name.c_str(), &s) == 0)
+			fchmod(fd, s.st_mode & 07777);
+
+		if(fsync(fd) == -1)
+			throw PageIOError(error_text("Error writing to", tmp));
+		if(close(fd) == -1)
+		{
+			fd = -1;
+			throw PageIOError(error_text("Error writing to", tmp));
+		}
+		fd = -1;
+
+		if(rename(tmp.c_str(), name.c_str()) == -1)
+			throw PageIOError(error_text("Error saving to", name));
+	}
+	catch(...)
+	{
+		if(fd != -1)
+			close(fd);
+		unlink(tmp.c_str());
+		throw;
+	}
+
+	sync_directory(name);
+}
+
+void read_page(const string& name, BasicImage<byte>& page)
+{
+	vector<byte> data;
+	if(!read_file(name, data))
+		throw PageIOError(error_text("Error reading from", name));
+
+	if(data.size() < size_t(page.size().area()))
+		throw PageIOError("\"" + name + "\" is too short to be a page");
+
+	for(int y=0; y < page.size().y; y++)
+		copy(data.begin() + y*page.size().x, data.begin() + (y+1)*page.size().x, page[y]);
+}
+
+bool read_file(const string& name, vector<byte>& data)
+{
+	int fd = open(name.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		if(errno == ENOENT)
+			return false;
+		throw PageIOError(error_text("Error opening", name));
+	}
+
+	data.clear();
+	byte buf[4096];
+	for(;;)
+	{
+		ssize_t r = read(fd, buf, sizeof(buf));
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r < 0)
+		{
+			close(fd);
+			throw PageIOError(error_text("Error reading from", name));
+		}
+		if(r == 0)
+			break;
+		data.insert(data.end(), buf, buf + r);
+	}
+
+	close(fd);
+	return true;
+}
+
+void remove_file(const string& name)
+{
+	if(unlink(name.c_str()) == -1 && errno != ENOENT)
+		throw PageIOError(error_text("Error removing", name));
+}
+
+string autosave_name(const string& page_name)
+{
+	string file;
+	int page, subpage;
+
+	if(page_name.empty())
+		return "untitled.autosave";
+	else if(!parse_archive_name(page_name, file, page, subpage))
+		return page_name + ".autosave";
+
+	ostringstream o;
+	o << file;
+	if(page != -1)
+		o << "." << hex << page << "-" << max(subpage, 0);
+	o << ".autosave";
+	return o.str();
+}
+
+template<class T> static void append(vector<byte>& v, const T& t)
+{
+	const byte* b = reinterpret_cast<const byte*>(&t);
+	v.insert(v.end(), b, b + sizeof(T));
+}
+
+template<class T> static T load(const byte* p)
+{
+	T t;
+	memcpy(&t, p, sizeof(T));
+	return t;
+}
+
+static const size_t header_bytes = sizeof(autosave_magic) + sizeof(uint64_t) + sizeof(uint32_t);
+static const size_t change_bytes = sizeof(uint16_t) + 1;
+
+vector<byte> make_autosave(const BasicImage<byte>& saved, const BasicImage<byte>& page)
+{
+	vector<byte> a(autosave_magic, autosave_magic + sizeof(autosave_magic));
+	append(a, PageArchive::hash(saved));
+	append(a, uint32_t(0));
+
+	uint32_t count=0;
+	const int w = page.size().x;
+	for(int y=0; y < page.size().y; y++)
+		for(int x=0; x < w; x++)
+			if(saved[y][x] != page[y][x])
+			{
+				append(a, uint16_t(y*w + x));
+				a.push_back(page[y][x]);
+				count++;
+			}
+
+	if(count == 0)
+		return vector<byte>();
+
+	memcpy(a.data() + header_bytes - sizeof(uint32_t), &count, sizeof(count));
+	return a;
+}
+
+bool apply_autosave(const vector<byte>& a, BasicImage<byte>& page)
+{
+	if(a.size() < header_bytes || memcmp(a.data(), autosave_magic, sizeof(autosave_magic)))
+		return false;
+
+	const byte* p = a.data() + sizeof(autosave_magic);
+	if(load<uint64_t>(p) != PageArchive::hash(page))
+		return false;
+
+	uint32_t count = load<uint32_t>(p + sizeof(uint64_t));
+	if(a.size() != header_bytes + count * change_bytes)
+		return false;
+
+	const int w = page.size().x;
+	p = a.data() + header_bytes;
+	for(uint32_t i=0; i < count; i++)
+		if(load<uint16_t>(p + i*change_bytes) >= page.size().area())
+			return false;
+
+	for(uint32_t i=0; i < count; i++, p += change_bytes)
+	{
+		int n = load<uint16_t>(p);
+		page[n / w][n % w] = p[sizeof(uint16_t)];
+	}
+
+	return true;
+}
+
+IOWorker::IOWorker()
+:jobs(numeric_limits<size_t>::max())
+{
+	worker = thread([this]{
+		TRACE_NAME_THREAD("I/O");
+		function<void()> job;
+		while(jobs.pop(job))
+		{
+			TRACE_SCOPE("I/O job");
+			job();
+		}
+	});
+}
+
+IOWorker::~IOWorker()
+{
+	finish();
+}
+
+void IOWorker::run(function<void()> job)
+{
+	jobs.push(move(job));
+}
+
+void IOWorker::finish()
+{
+	jobs.close();
+	if(worker.joinable())
+		worker.join();
+}
@@ -0,0 +1,86 @@
+#ifndef PAGE_IO_H_Vx8mRt2LqK5wNe
+#define PAGE_IO_H_Vx8mRt2LqK5wNe
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <stdexcept>
+#include "work_queue.h"
+
+//Reading and writing page files, done so that a crash at any point
+//leaves either the old file or the new one, and never half of each.
+
+struct PageIOError: public std::runtime_error
+{
+	using std::runtime_error::runtime_error;
+};
+
+//Writes the data to a temporary file beside name, syncs it to disk and
+//renames it over name. The file keeps its permissions if it exists.
+void replace_file(const std::string& name, const void* data, size_t size);
+
+//The same, but write() fills in the temporary file, given its name.
+void replace_file(const std::string& name, const std::function<void(const std::string&)>& write);
+
+//Reads a whole page from a file of raw bytes.
+void read_page(const std::string& name, CVD::BasicImage<CVD::byte>& page);
+
+//Reads a whole file. Returns false if it doesn't exist.
+bool read_file(const std::string& name, std::vector<CVD::byte>& data);
+
+//Removes a file, if it's there.
+void remove_file(const std::string& name);
+
+
+//Autosaves hold only the bytes of a page which differ from the copy
+//last loaded or saved, so they are tiny and applying one is instant.
+//
+//Layout (native byte order):
+//
+//  Magic     8 bytes, TTXAUTO1
+//  Hash      uint64, PageArchive::hash of the saved copy
+//  Count     uint32
+//  Changes   count of uint16 index, byte value
+//
+//The hash means an autosave is only ever applied to the page it was
+//made against, not to one which has since been changed by other means.
+
+//Where the autosave for a page goes: beside the page file, or beside
+//the archive for a page in one. Unnamed pages use untitled.autosave.
+std::string autosave_name(const std::string& page_name);
+
+//Empty if the page hasn't changed since it was saved.
+std::vector<CVD::byte> make_autosave(const CVD::BasicImage<CVD::byte>& saved, const CVD::BasicImage<CVD::byte>& page);
+
+//Applies the changes to the saved copy of the page. Returns false
+//(leaving the page alone) if the autosave is damaged or was made
+//against a different page.
+bool apply_autosave(const std::vector<CVD::byte>& autosave, CVD::BasicImage<CVD::byte>& page);
+
+
+//Runs jobs one at a time, in the order given, on a thread of its own,
+//so that a slow disk never holds up the caller. The queue isn't bounded,
+//so run() never waits either: the jobs are few and small (a save holds
+//a copy of one page), so they can't pile up enough to matter. Jobs must
+//catch their own exceptions.
+class IOWorker
+{
+	WorkQueue<std::function<void()>> jobs;
+	std::thread worker;
+
+	public:
+
+	IOWorker();
+
+	//Finishes the jobs already given.
+	~IOWorker();
+
+	void run(std::function<void()> job);
+
+	//Waits for the jobs already given. No more can be run afterwards.
+	void finish();
+};
+
+#endif
@@ -3,30 +3,112 @@
 #include <cvd/image.h>
 #include <cvd/rgb.h>
 #include <cvd/byte.h>
-#include <memory>
 #include <utility>
+#include <cstddef>
+#include "blit.h"
+#include "cells.h"
 
 class FontSet;
 
+//Formats for rendering into a caller's buffer. The indexed ones hold the
+//teletext colour number, 0-7 (bit 0 red, bit 1 green, bit 2 blue).
+enum class PixelFormat
+{
+	Index8,  //A byte per pixel
+	Index4,  //Two pixels per byte, the left one in the high nibble
+	RGB,     //CVD::Rgb<CVD::byte>
+	RGBA     //CVD::Rgba<CVD::byte>, with alpha 255
+};
+
 class Renderer
 {
-	std::unique_ptr<FontSet> f;
-	CVD::Image<CVD::Rgb<CVD::byte> > screen;
+	const FontSet* f;
+	BlitFunction blit;
 
 	public:
 
-	Renderer();
-	~Renderer();
-
 	static const int w=40;
 	static const int h=25;
 
-	const CVD::Image<CVD::Rgb<CVD::byte>>& render(const CVD::Image<CVD::byte> text, bool control, bool flash_on);
+	private:
+
+	//Flashing text is blanked in the off phase, so each phase has its own
+	//image. Each one remembers the cells drawn into it, so that only the
+	//changes need drawing and flipping phase on an unchanged page is free.
+	struct Phase
+	{
+		CVD::Image<CVD::Rgb<CVD::byte> > screen;
+		PageCells cells;
+		bool valid=false;
+		bool control=false;
+	};
+
+	Phase phases[2];
+	int current_phase=1;
+	int repainted=0;
+	bool page_flashes=false;
+
+	template<class Strip>
+	void draw_row(const PageCells& cells, int y, bool control, bool flash_on, const Strip& strip) const;
+
+	public:
+
+	//Renders at scale times the native 480x450 (up to 4), optionally with
+	//smoothed text. The scaled font is shared between renderers.
+	Renderer(int scale=1, bool rounding=false);
+	Renderer(const Renderer&) = delete;
+	Renderer& operator=(const Renderer&) = delete;
+
+	//Render into the renderer's own image, redrawing only what changed
+	//since the last call. This keeps state, so each thread needs its own
+	//Renderer to use it (the font is shared regardless).
+	const CVD::Image<CVD::Rgb<CVD::byte>>& render(const CVD::BasicImage<CVD::byte>& text, bool control, bool flash_on);
+
+	//Render the whole page straight into a buffer of size() pixels, with
+	//rows stride bytes apart. Unlike the above, this draws everything
+	//every time, and leaves get_rendered() alone. It only reads the
+	//renderer, so any number of threads can share one, each rendering
+	//into its own buffer.
+	void render(const CVD::BasicImage<CVD::byte>& text, bool control, bool flash_on, PixelFormat format, void* out, size_t stride) const;
+
+	//Rendering is decode_cells() followed by drawing the cells. These
+	//take the cells directly, for callers which have them already.
+	const CVD::Image<CVD::Rgb<CVD::byte>>& render(const PageCells& cells, bool control, bool flash_on);
+	void render(const PageCells& cells, bool control, bool flash_on, PixelFormat format, void* out, size_t stride) const;
+
 	const CVD::Image<CVD::Rgb<CVD::byte>>& get_rendered()
 	{
-		return screen;
+		return phases[current_phase].screen;
 	}
 
+	//Whether the last page rendered has any flash codes. If not, both
+	//phases are the same and there's no point in flashing.
+	bool flashing() const
+	{
+		return page_flashes;
+	}
+
+	//Number of rows actually drawn by the last call to render.
+	int repainted_rows() const
+	{
+		return repainted;
+	}
+
+	//Forget the last page, so the next render draws everything.
+	void invalidate();
+
+	//Defaults to the fastest one available. Output is identical either way.
+	void set_blit_kernel(BlitKernel k);
+
+	void set_scale(int scale, bool rounding=false);
+	int scale() const;
+
+	//The size of the rendered page in pixels.
+	CVD::ImageRef size() const;
+
+	//The RGB value of colour number i.
+	static CVD::Rgb<CVD::byte> colour(int i);
+
 	CVD::ImageRef glyph_size() const;
 	
 	//The bounding box in pixels of the character under the current sixel in the image
@@ -0,0 +1,29 @@
+#ifndef RESOURCE_H_Tm6yPq3WcX9nLe
+#define RESOURCE_H_Tm6yPq3WcX9nLe
+#include <cstddef>
+#include <string>
+
+//A block of data embedded in the program by file_to_C. It's read in
+//place: nothing is copied unless str() is called.
+struct Resource
+{
+	const unsigned char* data;
+	std::size_t size;
+
+	const unsigned char* begin() const
+	{
+		return data;
+	}
+
+	const unsigned char* end() const
+	{
+		return data + size;
+	}
+
+	std::string str() const
+	{
+		return std::string(begin(), end());
+	}
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include "sixel_plane.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+using namespace CVD;
+
+static const uint64_t all = ~uint64_t(0);
+
+//The bits in the first n of a word.
+static uint64_t low(int n)
+{
+	return n <= 0 ? 0 : n >= 64 ? all : (uint64_t(1) << n) - 1;
+}
+
+SixelRow SixelRow::span(int x0, int x1)
+{
+	SixelRow r;
+	r.w[0] = low(x1) & ~low(x0);
+	r.w[1] = low(x1-64) & ~low(x0-64);
+	return r;
+}
+
+void SixelRow::apply(const SixelRow& m, Set way)
+{
+	for(int i=0; i < 2; i++)
+		if(way == Set::On)
+			w[i] |= m.w[i];
+		else if(way == Set::Off)
+			w[i] &= ~m.w[i];
+		else
+			w[i] ^= m.w[i];
+}
+
+void SixelRow::shift_right(int x0, int x1)
+{
+	SixelRow m = span(x0+1, x1);
+	uint64_t s[2] = {w[0] << 1, (w[1] << 1) | (w[0] >> 63)};
+	for(int i=0; i < 2; i++)
+		w[i] = (w[i] & ~span(x0, x1).w[i]) | (s[i] & m.w[i]);
+}
+
+void SixelRow::shift_left(int x0, int x1)
+{
+	SixelRow m = span(x0, x1-1);
+	uint64_t s[2] = {(w[0] >> 1) | (w[1] << 63), w[1] >> 1};
+	for(int i=0; i < 2; i++)
+		w[i] = (w[i] & ~span(x0, x1).w[i]) | (s[i] & m.w[i]);
+}
+
+int SixelRow::next_clear(int x) const
+{
+	for(int i=x>>6; i < 2; i++)
+	{
+		uint64_t c = ~w[i] & ~low(x - i*64);
+		if(c)
+			return min(SixelPlane::w, i*64 + __builtin_ctzll(c));
+	}
+	return SixelPlane::w;
+}
+
+int SixelRow::prev_clear(int x) const
+{
+	for(int i=x>>6; i >= 0; i--)
+	{
+		uint64_t c = ~w[i] & low(x - i*64 + 1);
+		if(c)
+			return i*64 + 63 - __builtin_clzll(c);
+	}
+	return -1;
+}
+
+//Sixel row r of a cell is bits 2r and 2r+1, except that the bottom
+//right sixel is bit 6, since bit 5 is what makes it a graphic.
+static int left_bit(int r)
+{
+	return 2*r;
+}
+
+static int right_bit(int r)
+{
+	return r == 2 ? 6 : 2*r+1;
+}
+
+SixelRow read_sixel_row(const BasicImage<byte>& page, int y)
+{
+	SixelRow row;
+	const byte* cells = page[y/3];
+	const int l = left_bit(y%3), r = right_bit(y%3);
+
+	for(int x=0; x < page.size().x; x++)
+	{
+		int c = cells[x];
+		if(c & 32)
+			row.w[x>>5] |= uint64_t(((c >> l) & 1) | (((c >> r) & 1) << 1)) << (2*x & 63);
+	}
+
+	return row;
+}
+
+void write_sixel_row(BasicImage<byte>& page, int y, const SixelRow& row)
+{
+	byte* cells = page[y/3];
+	const int l = left_bit(y%3), r = right_bit(y%3);
+	const int mask = (1<<l) | (1<<r);
+
+	for(int x=0; x < page.size().x; x++)
+		if(cells[x] & 32)
+		{
+			int s = row.w[x>>5] >> (2*x & 63);
+			cells[x] = (cells[x] & ~mask) | ((s & 1) << l) | (((s >> 1) & 1) << r);
+		}
+}
+
+SixelPlane::SixelPlane(const BasicImage<byte>& page)
+{
+	for(int y=0; y < h; y++)
+		rows[y] = read_sixel_row(page, y);
+
+	for(int y=0; y < h; y += 3)
+	{
+		SixelRow g;
+		for(int x=0; x < w/2; x++)
+			if(page[y/3][x] & 32)
+				g.apply(SixelRow::span(2*x, 2*x+2), Set::On);
+		graphics[y] = graphics[y+1] = graphics[y+2] = g;
+	}
+}
+
+void SixelPlane::store(BasicImage<byte>& page) const
+{
+	for(int y=0; y < h; y++)
+		write_sixel_row(page, y, rows[y]);
+}
+
+void SixelPlane::set(int x, int y, Set way)
+{
+	if(graphics[y].get(x))
+		rows[y].set(x, way);
+}
+
+void SixelPlane::insert_column(int x)
+{
+	for(int y=0; y < h; y++)
+		if(graphics[y].get(x))
+			rows[y].shift_right(x, graphics[y].next_clear(x));
+}
+
+void SixelPlane::delete_column(int x)
+{
+	for(int y=0; y < h; y++)
+		if(graphics[y].get(x))
+			rows[y].shift_left(x, graphics[y].next_clear(x));
+}
+
+void SixelPlane::insert_row(int y)
+{
+	for(int r=h-1; r > y; r--)
+		for(int i=0; i < 2; i++)
+			rows[r].w[i] = rows[r-1].w[i] & graphics[r].w[i];
+	rows[y] = SixelRow();
+}
+
+void SixelPlane::delete_row(int y)
+{
+	for(int r=y; r < h-1; r++)
+		for(int i=0; i < 2; i++)
+			rows[r].w[i] = rows[r+1].w[i] & graphics[r].w[i];
+	rows[h-1] = SixelRow();
+}
+
+void SixelPlane::fill(ImageRef tl, ImageRef br, Set way)
+{
+	tl = ImageRef(max(tl.x, 0), max(tl.y, 0));
+	br = ImageRef(min(br.x, w), min(br.y, h));
+	if(tl.x >= br.x)
+		return;
+
+	const SixelRow s = SixelRow::span(tl.x, br.x);
+	for(int y=tl.y; y < br.y; y++)
+	{
+		SixelRow m;
+		for(int i=0; i < 2; i++)
+			m.w[i] = s.w[i] & graphics[y].w[i];
+		rows[y].apply(m, way);
+	}
+}
+
+void SixelPlane::line(ImageRef a, ImageRef b, Set way)
+{
+	const int dx = abs(b.x - a.x), dy = -abs(b.y - a.y);
+	const int sx = a.x < b.x ? 1 : -1, sy = a.y < b.y ? 1 : -1;
+	int err = dx + dy;
+
+	while(true)
+	{
+		if(a.x >= 0 && a.x < w && a.y >= 0 && a.y < h)
+			set(a.x, a.y, way);
+		if(a == b)
+			break;
+
+		int e2 = 2*err;
+		if(e2 >= dy)
+		{
+			err += dy;
+			a.x += sx;
+		}
+		if(e2 <= dx)
+		{
+			err += dx;
+			a.y += sy;
+		}
+	}
+}
+
+void SixelPlane::draw(SixelRow (&shape)[h], Set way, bool filled)
+{
+	//The outline is everything in the shape with a neighbour outside it.
+	SixelRow out[h];
+	for(int y=0; y < h; y++)
+	{
+		const SixelRow& s = shape[y];
+		out[y] = s;
+
+		if(!filled)
+		{
+			const SixelRow none;
+			const SixelRow& up = y > 0 ? shape[y-1] : none;
+			const SixelRow& down = y < h-1 ? shape[y+1] : none;
+			uint64_t l[2] = {s.w[0] << 1, (s.w[1] << 1) | (s.w[0] >> 63)};
+			uint64_t r[2] = {(s.w[0] >> 1) | (s.w[1] << 63), s.w[1] >> 1};
+
+			for(int i=0; i < 2; i++)
+				out[y].w[i] = s.w[i] & ~(l[i] & r[i] & up.w[i] & down.w[i]);
+		}
+
+		for(int i=0; i < 2; i++)
+			out[y].w[i] &= graphics[y].w[i];
+		rows[y].apply(out[y], way);
+	}
+}
+
+void SixelPlane::rectangle(ImageRef tl, ImageRef br, Set way, bool filled)
+{
+	SixelRow shape[h];
+	const SixelRow s = SixelRow::span(max(tl.x, 0), min(br.x, w));
+	for(int y=max(tl.y, 0); y < min(br.y, h); y++)
+		shape[y] = s;
+
+	draw(shape, way, filled);
+}
+
+void SixelPlane::ellipse(ImageRef tl, ImageRef br, Set way, bool filled)
+{
+	//Sixels are in if their centres are.
+	const double mx = (tl.x + br.x) / 2.0, my = (tl.y + br.y) / 2.0;
+	const double rx = (br.x - tl.x) / 2.0, ry = (br.y - tl.y) / 2.0;
+	SixelRow shape[h];
+
+	if(rx > 0 && ry > 0)
+		for(int y=max(tl.y, 0); y < min(br.y, h); y++)
+		{
+			double dy = (y + .5 - my) / ry;
+			if(dy*dy > 1)
+				continue;
+
+			double half = rx * sqrt(1 - dy*dy);
+			int x0 = int(ceil(mx - half - .5));
+			int x1 = int(floor(mx + half - .5)) + 1;
+			shape[y] = SixelRow::span(max(x0, 0), min(x1, w));
+		}
+
+	draw(shape, way, filled);
+}
+
+//A scanline fill. Each run of sixels is filled in one go, and then the
+//runs touching it above and below go on the stack, one entry per run,
+//so the stack stays small and nothing is allocated per sixel.
+void SixelPlane::flood_fill(ImageRef p, const SixelRow* mask)
+{
+	if(p.x < 0 || p.x >= w || p.y < 0 || p.y >= h || !graphics[p.y].get(p.x))
+		return;
+
+	//The sixels which could be filled, and are yet to be.
+	const bool value = get(p.x, p.y);
+	SixelRow open[h];
+	for(int y=0; y < h; y++)
+		for(int i=0; i < 2; i++)
+			open[y].w[i] = (value ? rows[y].w[i] : ~rows[y].w[i]) & graphics[y].w[i] & (mask ? mask[y].w[i] : all);
+
+	if(!open[p.y].get(p.x))
+		return;
+
+	vector<ImageRef> stack;
+	stack.reserve(2*h);
+	stack.push_back(p);
+
+	while(!stack.empty())
+	{
+		ImageRef s = stack.back();
+		stack.pop_back();
+
+		SixelRow& o = open[s.y];
+		if(!o.get(s.x))
+			continue;
+
+		//Find the run with word operations.
+		const SixelRow run = SixelRow::span(o.prev_clear(s.x) + 1, o.next_clear(s.x));
+
+		rows[s.y].apply(run, Set::Toggle);
+		o.apply(run, Set::Off);
+
+		for(int y: {s.y-1, s.y+1})
+		{
+			if(y < 0 || y >= h)
+				continue;
+
+			//Each run of open sixels touching this one.
+			SixelRow touching;
+			for(int i=0; i < 2; i++)
+				touching.w[i] = open[y].w[i] & run.w[i];
+
+			for(int i=0; i < 2; i++)
+				for(uint64_t t = touching.w[i]; t; )
+				{
+					int x = __builtin_ctzll(t);
+					stack.push_back(ImageRef(i*64 + x, y));
+
+					//Skip to the end of the run in the open row.
+					int end = open[y].next_clear(i*64 + x) - i*64;
+					t &= ~low(end);
+				}
+		}
+	}
+}
@@ -0,0 +1,111 @@
+#ifndef SIXEL_PLANE_H_Tb6wXq3nLz8RcF
+#define SIXEL_PLANE_H_Tb6wXq3nLz8RcF
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include <cstdint>
+#include "page_edit.h"
+
+//The sixels of a page as bits, so that editing them is a few word
+//operations rather than a loop working out the cell and bit for every
+//sixel.
+
+//One row of 80 sixels, with sixel x in bit x%64 of word x/64.
+struct SixelRow
+{
+	uint64_t w[2]={0,0};
+
+	//Sixels x0 to x1-1 set, the rest clear.
+	static SixelRow span(int x0, int x1);
+
+	bool get(int x) const
+	{
+		return (w[x>>6] >> (x&63)) & 1;
+	}
+
+	void set(int x, Set way)
+	{
+		apply(span(x, x+1), way);
+	}
+
+	//Set, clear or toggle the sixels which are set in mask.
+	void apply(const SixelRow& mask, Set way);
+
+	//Shift sixels x0 to x1-1 along by one, leaving the ones at each end
+	//clear: right means towards higher x.
+	void shift_right(int x0, int x1);
+	void shift_left(int x0, int x1);
+
+	//The first clear sixel at or after x, or 80 if there isn't one.
+	int next_clear(int x) const;
+
+	//The last clear sixel at or before x, or -1 if there isn't one.
+	int prev_clear(int x) const;
+};
+
+//Sixel row y of a page, with the sixels in non-graphics cells clear.
+SixelRow read_sixel_row(const CVD::BasicImage<CVD::byte>& page, int y);
+
+//Write a row back into the graphics cells of the page. Other cells are
+//left alone.
+void write_sixel_row(CVD::BasicImage<CVD::byte>& page, int y, const SixelRow& r);
+
+//All 80x75 sixels of a page. Edits are made to the plane and put back
+//into the page in one go with store(). Sixels only exist in graphics
+//cells, so anything moved outside them is lost.
+class SixelPlane
+{
+	public:
+
+	static const int w=80;
+	static const int h=75;
+
+	private:
+
+	SixelRow rows[h];
+
+	//Which sixels are in graphics cells.
+	SixelRow graphics[h];
+
+	//Set, clear or toggle a shape given as a row for each sixel row,
+	//or just its outline.
+	void draw(SixelRow (&shape)[h], Set way, bool filled);
+
+	public:
+
+	explicit SixelPlane(const CVD::BasicImage<CVD::byte>& page);
+
+	void store(CVD::BasicImage<CVD::byte>& page) const;
+
+	bool get(int x, int y) const
+	{
+		return rows[y].get(x);
+	}
+
+	void set(int x, int y, Set way);
+
+	//Like insert_sixel and delete_sixel on every row at once.
+	void insert_column(int x);
+	void delete_column(int x);
+
+	//Move the sixel rows from y down (or up) by one, leaving a clear row.
+	void insert_row(int y);
+	void delete_row(int y);
+
+	//The rectangle from tl up to but not including br.
+	void fill(CVD::ImageRef tl, CVD::ImageRef br, Set way);
+
+	//A straight line from a to b, including both ends.
+	void line(CVD::ImageRef a, CVD::ImageRef b, Set way);
+
+	//Shapes in the rectangle from tl up to but not including br, either
+	//filled or just the outline.
+	void rectangle(CVD::ImageRef tl, CVD::ImageRef br, Set way, bool filled);
+	void ellipse(CVD::ImageRef tl, CVD::ImageRef br, Set way, bool filled);
+
+	//Flip every sixel which is the same as the one at p and joined to it
+	//(across, or up and down). Only sixels set in mask (h rows) are
+	//included, if it's given.
+	void flood_fill(CVD::ImageRef p, const SixelRow* mask=nullptr);
+};
+
+#endif
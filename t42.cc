@@ -0,0 +1,157 @@
+#include "t42.h"
+#include <algorithm>
+
+using namespace std;
+using namespace CVD;
+
+namespace
+{
+	//Decoding is all table lookups. The Hamming table holds the data
+	//nibble, plus 16 if a bit error was corrected, or -1 if the byte
+	//can't be decoded. The parity table holds whether the byte has odd
+	//parity.
+	struct Tables
+	{
+		signed char hamming[256];
+		bool odd_parity[256];
+
+		Tables()
+		{
+			//Hamming 8/4 codewords for 0-15, with bits in transmission order
+			//(P1 D1 P2 D2 P3 D3 P4 D4 from the lsb). Any two differ in at
+			//least 4 bits, so one bit error can be corrected and two can be
+			//detected.
+			const byte codewords[16] = {
+				0x15, 0x02, 0x49, 0x5e, 0x64, 0x73, 0x38, 0x2f,
+				0xd0, 0xc7, 0x8c, 0x9b, 0xa1, 0xb6, 0xfd, 0xea
+			};
+
+			fill(hamming, hamming+256, -1);
+			for(int d=0; d < 16; d++)
+			{
+				hamming[codewords[d]] = d;
+				for(int b=0; b < 8; b++)
+					hamming[codewords[d] ^ (1<<b)] = d + 16;
+			}
+
+			for(int i=0; i < 256; i++)
+			{
+				int bits=0;
+				for(int b=0; b < 8; b++)
+					bits += (i>>b)&1;
+				odd_parity[i] = bits & 1;
+			}
+		}
+	};
+
+	const Tables tables;
+}
+
+T42Decoder::T42Decoder(PageCallback callback)
+:done(callback)
+{
+	for(auto& m: magazines)
+		m.page.text.resize(ImageRef(40, 25));
+}
+
+int T42Decoder::hamming(byte b)
+{
+	int d = tables.hamming[b];
+	if(d < 0)
+		s.hamming_errors++;
+	else if(d >= 16)
+	{
+		s.hamming_corrected++;
+		d -= 16;
+	}
+	return d;
+}
+
+byte T42Decoder::character(byte b)
+{
+	if(tables.odd_parity[b])
+		return b & 0x7f;
+
+	s.parity_errors++;
+	return ' ';
+}
+
+void T42Decoder::finish(Magazine& m)
+{
+	if(m.active)
+	{
+		s.pages++;
+		done(m.page);
+	}
+	m.active = false;
+}
+
+void T42Decoder::flush()
+{
+	for(auto& m: magazines)
+		finish(m);
+}
+
+void T42Decoder::decode(const byte* p)
+{
+	s.packets++;
+
+	int m0 = hamming(p[0]);
+	int m1 = hamming(p[1]);
+	if(m0 < 0 || m1 < 0)
+		return;
+
+	const int mrag = m0 | (m1 << 4);
+	Magazine& mag = magazines[mrag & 7];
+	const int row = mrag >> 3;
+
+	if(row == 0)
+	{
+		int h[8];
+		bool ok=true;
+		for(int i=0; i < 8; i++)
+		{
+			h[i] = hamming(p[2+i]);
+			ok &= h[i] >= 0;
+		}
+
+		//A header always ends the magazine's page, even if it's too
+		//damaged to say what comes next.
+		if(!ok)
+		{
+			finish(mag);
+			return;
+		}
+
+		const int control = ((h[3] >> 3) << 4) | ((h[5] >> 2) << 5) | (h[6] << 7) | (h[7] << 11);
+		const bool serial = h[7] & 1;
+
+		if(serial)
+			flush();
+		else
+			finish(mag);
+
+		//Page xFF is filler, sent just to end the previous page.
+		if(h[0] == 0xf && h[1] == 0xf)
+			return;
+
+		const int magazine = (mrag & 7) ? (mrag & 7) : 8;
+
+		Page& page = mag.page;
+		page.number = (magazine << 8) | (h[1] << 4) | h[0];
+		page.subcode = h[2] | ((h[3] & 7) << 4) | (h[4] << 8) | ((h[5] & 3) << 12);
+		page.control = control;
+		fill(page.text.begin(), page.text.end(), ' ');
+
+		for(int x=8; x < 40; x++)
+			page.text[0][x] = character(p[2+x]);
+
+		mag.active = true;
+	}
+	else if(row < 25 && mag.active)
+	{
+		byte* out = mag.page.text[row];
+		for(int x=0; x < 40; x++)
+			out[x] = character(p[2+x]);
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef T42_H_Zc5nHw2kRq7vLb
+#define T42_H_Zc5nHw2kRq7vLb
+#include <cvd/image.h>
+#include <cvd/byte.h>
+#include <cstdint>
+#include <functional>
+
+//Assembles pages from a stream of T42 packets (as captured from VBI).
+//
+//Each packet is 42 bytes: two Hamming 8/4 bytes of magazine and row,
+//then 40 bytes of payload. Row 0 is the page header, with 8 more
+//Hamming bytes of page number, subcode and control bits followed by 32
+//characters. Rows 1-24 are 40 characters each. Characters are 7 bit
+//with odd parity. Higher rows carry enhancements and are skipped.
+//
+//Each magazine has its own page in progress, which is complete when the
+//next header for that magazine arrives (or any header, if the header
+//says the magazines are being sent serially).
+class T42Decoder
+{
+	public:
+
+	static const int packet_bytes = 42;
+
+	struct Page
+	{
+		//Magazine in the top nibble, e.g. 0x1a0. Magazine 0 is sent as 8.
+		int number;
+		int subcode;
+
+		//Control bits C4 (bit 4) to C14 (bit 14).
+		int control;
+
+		CVD::Image<CVD::byte> text;
+	};
+
+	struct Stats
+	{
+		uint64_t packets=0;
+		uint64_t pages=0;
+
+		//Hamming bytes with a single bit error, which was fixed
+		uint64_t hamming_corrected=0;
+
+		//Hamming bytes which couldn't be fixed. The packet is dropped.
+		uint64_t hamming_errors=0;
+
+		//Characters with bad parity. They are replaced with spaces.
+		uint64_t parity_errors=0;
+	};
+
+	typedef std::function<void(const Page&)> PageCallback;
+
+	private:
+
+	struct Magazine
+	{
+		bool active=false;
+		Page page;
+	};
+
+	Magazine magazines[8];
+	Stats s;
+	PageCallback done;
+
+	int hamming(CVD::byte b);
+	CVD::byte character(CVD::byte b);
+	void finish(Magazine& m);
+
+	public:
+
+	//The callback is called with each page as it's completed.
+	T42Decoder(PageCallback callback);
+
+	void decode(const CVD::byte* packet);
+
+	//Complete any pages which are still in progress.
+	void flush();
+
+	const Stats& stats() const
+	{
+		return s;
+	}
+};
+
+#endif
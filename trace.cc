@@ -0,0 +1,225 @@
+#include "trace.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+
+#ifdef TTX_TRACE
+const bool Trace::enabled=true;
+#else
+const bool Trace::enabled=false;
+#endif
+
+namespace
+{
+	//Only the owning thread writes a ring, but anyone can read it, so each
+	//slot is guarded by a sequence number: it's cleared before the event is
+	//written and set afterwards, and a reader which sees it change (or
+	//not match) throws the event away.
+	struct Slot
+	{
+		atomic<uint64_t> seq{~uint64_t(0)};
+		atomic<const char*> name{nullptr};
+		atomic<uint64_t> start{0}, duration{0};
+		atomic<int64_t> value{0};
+	};
+
+	struct Event
+	{
+		const char* name;
+		uint64_t start, duration;
+		int64_t value;
+	};
+
+	struct Ring
+	{
+		static const size_t size = 1<<14;
+		Slot slots[size];
+		atomic<uint64_t> head{0}; //Events ever written
+		int tid;
+		string name;
+	};
+
+	//Rings are never freed, so that the events of threads which have
+	//finished can still be written out.
+	mutex registry_lock;
+	vector<unique_ptr<Ring>> registry;
+	thread_local Ring* this_thread_ring=nullptr;
+
+	Ring& thread_ring()
+	{
+		if(!this_thread_ring)
+		{
+			lock_guard<mutex> lock(registry_lock);
+			registry.emplace_back(new Ring);
+			this_thread_ring = registry.back().get();
+			this_thread_ring->tid = registry.size();
+			this_thread_ring->name = "thread " + to_string(registry.size());
+		}
+		return *this_thread_ring;
+	}
+
+	//Calls f on the events in the ring, newest first, until it returns false.
+	template<class F> void each_event(const Ring& r, const F& f)
+	{
+		const uint64_t h = r.head.load(memory_order_acquire);
+
+		for(uint64_t i=h; i > 0 && i + Ring::size > h; i--)
+		{
+			const Slot& s = r.slots[(i-1) % Ring::size];
+
+			if(s.seq.load(memory_order_acquire) != i-1)
+				continue;
+
+			Event e{s.name.load(memory_order_relaxed), s.start.load(memory_order_relaxed), s.duration.load(memory_order_relaxed), s.value.load(memory_order_relaxed)};
+			atomic_thread_fence(memory_order_acquire);
+
+			if(s.seq.load(memory_order_relaxed) != i-1)
+				continue;
+
+			if(!f(e))
+				return;
+		}
+	}
+
+	vector<Ring*> rings()
+	{
+		lock_guard<mutex> lock(registry_lock);
+		vector<Ring*> r;
+		for(auto& i: registry)
+			r.push_back(i.get());
+		return r;
+	}
+
+	void write_string(ostream& out, const string& s)
+	{
+		out << '"';
+		for(char c: s)
+			if(c == '"' || c == '\\')
+				out << '\\' << c;
+			else if((unsigned char)c < 32)
+				out << ' ';
+			else
+				out << c;
+		out << '"';
+	}
+}
+
+uint64_t Trace::now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char* name, uint64_t start, uint64_t end, int64_t value)
+{
+	Ring& r = thread_ring();
+	const uint64_t i = r.head.load(memory_order_relaxed);
+	Slot& s = r.slots[i % Ring::size];
+
+	s.seq.store(~uint64_t(0), memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	s.name.store(name, memory_order_relaxed);
+	s.start.store(start, memory_order_relaxed);
+	s.duration.store(end - start, memory_order_relaxed);
+	s.value.store(value, memory_order_relaxed);
+	s.seq.store(i, memory_order_release);
+	r.head.store(i+1, memory_order_release);
+}
+
+void Trace::name_thread(const string& name)
+{
+	if(!enabled)
+		return;
+
+	Ring& r = thread_ring();
+	lock_guard<mutex> lock(registry_lock);
+	r.name = name;
+}
+
+void Trace::write_chrome_json(ostream& out)
+{
+	const vector<Ring*> all = rings();
+
+	//Timestamps are relative to the earliest event, in microseconds.
+	vector<vector<Event>> events(all.size());
+	uint64_t t0 = ~uint64_t(0);
+	for(size_t i=0; i < all.size(); i++)
+	{
+		each_event(*all[i], [&](const Event& e){
+			events[i].push_back(e);
+			t0 = min(t0, e.start);
+			return true;
+		});
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first=true;
+	out << fixed << setprecision(3);
+
+	for(size_t i=0; i < all.size(); i++)
+	{
+		string name;
+		{
+			lock_guard<mutex> lock(registry_lock);
+			name = all[i]->name;
+		}
+
+		out << (first?"":",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << all[i]->tid << ",\"args\":{\"name\":";
+		write_string(out, name);
+		out << "}}";
+		first=false;
+
+		for(auto e=events[i].rbegin(); e != events[i].rend(); e++)
+		{
+			out << ",\n{\"ph\":\"X\",\"name\":";
+			write_string(out, e->name);
+			out << ",\"pid\":1,\"tid\":" << all[i]->tid << ",\"ts\":" << (e->start - t0) / 1000.0 << ",\"dur\":" << e->duration / 1000.0;
+			if(e->value >= 0)
+				out << ",\"args\":{\"value\":" << e->value << "}";
+			out << "}";
+		}
+	}
+
+	out << "\n]}\n";
+}
+
+vector<uint64_t> Trace::recent(const char* name, size_t n)
+{
+	vector<pair<uint64_t, uint64_t>> found; //start, duration
+
+	for(Ring* r: rings())
+	{
+		size_t count=0;
+		each_event(*r, [&](const Event& e){
+			if(strcmp(e.name, name) == 0)
+			{
+				found.emplace_back(e.start, e.duration);
+				count++;
+			}
+			return count < n;
+		});
+	}
+
+	sort(found.rbegin(), found.rend());
+	found.resize(min(found.size(), n));
+
+	vector<uint64_t> d;
+	for(const auto& f: found)
+		d.push_back(f.second);
+	return d;
+}
+
+uint64_t Trace::percentile(vector<uint64_t> d, double p)
+{
+	if(d.empty())
+		return 0;
+
+	size_t i = min(d.size()-1, size_t(p / 100 * d.size()));
+	nth_element(d.begin(), d.begin() + i, d.end());
+	return d[i];
+}
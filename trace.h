@@ -0,0 +1,79 @@
+#ifndef TRACE_H_Hc6pWz1uEr9sJd
+#define TRACE_H_Hc6pWz1uEr9sJd
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+//Timing trace points. They compile to nothing unless built with
+//TTX_TRACE defined (make TRACE=1), so they can go anywhere:
+//
+//	TRACE_SCOPE("render");         //Times the rest of the block
+//	TRACE_SCOPE_VALUE("key", k);   //The same, noting a number too
+//	TRACE_NAME_THREAD("I/O");      //Names the calling thread
+//
+//Each thread records into a ring buffer of its own, so recording an
+//event takes no locks, just two clock reads and a few stores. When a
+//ring fills up, the oldest events are overwritten. The rings can be
+//read at any time from any thread, e.g. to write them out as Chrome
+//trace event JSON, which chrome://tracing and ui.perfetto.dev load.
+
+namespace Trace
+{
+	//True if the trace points are compiled in.
+	extern const bool enabled;
+
+	//Nanoseconds from a steady clock.
+	uint64_t now();
+
+	void record(const char* name, uint64_t start, uint64_t end, int64_t value=-1);
+
+	//Names the calling thread in the trace. Does nothing (and makes no
+	//ring) without TTX_TRACE.
+	void name_thread(const std::string& name);
+
+	//Writes every event still in the rings.
+	void write_chrome_json(std::ostream& out);
+
+	//The durations (in ns) of up to n of the latest events with the given
+	//name, from all threads, most recent first.
+	std::vector<uint64_t> recent(const char* name, size_t n);
+
+	//The p'th percentile (0-100) of some durations, or 0 if there are none.
+	uint64_t percentile(std::vector<uint64_t> d, double p);
+
+	class Scope
+	{
+		const char* name;
+		int64_t value;
+		uint64_t start;
+
+		public:
+		Scope(const char* n, int64_t v=-1)
+		:name(n),value(v),start(now())
+		{}
+
+		~Scope()
+		{
+			record(name, start, now(), value);
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+}
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+
+#ifdef TTX_TRACE
+	#define TRACE_SCOPE(name) Trace::Scope TRACE_JOIN(trace_scope_, __LINE__)(name)
+	#define TRACE_SCOPE_VALUE(name, value) Trace::Scope TRACE_JOIN(trace_scope_, __LINE__)(name, value)
+	#define TRACE_NAME_THREAD(name) Trace::name_thread(name)
+#else
+	#define TRACE_SCOPE(name) do{}while(0)
+	#define TRACE_SCOPE_VALUE(name, value) do{}while(0)
+	#define TRACE_NAME_THREAD(name) do{}while(0)
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#include <cvd/image.h>
+
+#include "archive.h"
+
+using namespace std;
+using namespace CVD;
+
+//Makes, lists and unpacks page archives.
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " create archive.ttxa page_file ...\n"
+	     << "       " << name << " list archive.ttxa\n"
+	     << "       " << name << " extract archive.ttxa [dir]\n"
+	     << "\n"
+	     << "Pages are numbered 100/0, 100/1, ... in the order given. A page\n"
+	     << "file of - reads page file names from stdin, one per line.\n";
+}
+
+string base_name(const string& name)
+{
+	return name.substr(name.find_last_of('/') + 1);
+}
+
+int create(const string& archive, int argc, char** argv)
+{
+	ArchiveWriter w(archive);
+	int page = 0x100, subpage = 0;
+	int failed = 0;
+
+	auto add = [&](const string& name)
+	{
+		ifstream in(name);
+		Image<byte> text(ImageRef(40, 25));
+		in.read(reinterpret_cast<char*>(text.data()), text.size().area());
+
+		if(!in.good())
+		{
+			cerr << "Error reading from \"" << name << "\": " << strerror(errno) << endl;
+			failed++;
+			return;
+		}
+
+		w.add(page, subpage, base_name(name), text);
+
+		if(++subpage > 0xffff)
+		{
+			subpage = 0;
+			page++;
+		}
+	};
+
+	for(int i=0; i < argc; i++)
+	{
+		if(string(argv[i]) == "-")
+		{
+			string name;
+			while(getline(cin, name))
+				if(!name.empty())
+					add(name);
+		}
+		else
+			add(argv[i]);
+	}
+
+	w.finish();
+	return failed != 0;
+}
+
+int list(const string& archive)
+{
+	PageArchive a(archive);
+
+	for(size_t i=0; i < a.size(); i++)
+	{
+		const PageArchive::Entry& e = a.entry(i);
+		cout << hex << setfill(' ') << setw(3) << e.page << "/" << setw(4) << left << e.subpage << right << " "
+		     << setfill('0') << setw(16) << e.hash << " " << a.name(i) << "\n";
+	}
+
+	return 0;
+}
+
+int extract(const string& archive, const string& dir)
+{
+	PageArchive a(archive);
+	int failed = 0;
+
+	for(size_t i=0; i < a.size(); i++)
+	{
+		const PageArchive::Entry& e = a.entry(i);
+		string name = a.name(i);
+		if(name.empty())
+		{
+			ostringstream s;
+			s << hex << e.page << "_" << e.subpage << ".txt";
+			name = s.str();
+		}
+		name = dir + "/" + name;
+
+		ofstream out(name);
+		BasicImage<byte> text = a.page(i);
+		out.write(reinterpret_cast<const char*>(text.data()), text.size().area());
+
+		if(!out.good())
+		{
+			cerr << "Error writing to \"" << name << "\": " << strerror(errno) << endl;
+			failed++;
+		}
+	}
+
+	return failed != 0;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 3)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	string command = argv[1];
+	string archive = argv[2];
+
+	try
+	{
+		if(command == "create")
+			return create(archive, argc-3, argv+3);
+		else if(command == "list" && argc == 3)
+			return list(archive);
+		else if(command == "extract" && argc <= 4)
+			return extract(archive, argc == 4 ? argv[3] : ".");
+	}
+	catch(ArchiveError& e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	usage(argv[0]);
+	return 1;
+}
@@ -0,0 +1,353 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include <unistd.h>
+
+#include <cvd/image.h>
+
+#include "render.h"
+#include "font.h"
+#include "page_edit.h"
+#include "sixel_plane.h"
+
+using namespace std;
+using namespace CVD;
+
+//Times the things which might get slower between releases: building the
+//font, rendering pages and the editor's row and sixel operations.
+//
+//Results are printed one per line, tab separated, so that runs can be
+//compared with diff, awk or a spreadsheet:
+//
+//	name  samples  median_ns  p99_ns  ops_per_s
+//
+//Very quick operations are timed in batches and the time divided by the
+//batch size, so their latencies are per operation averaged over a batch.
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " [-n samples] [-t threads] [page_file ...]\n"
+	     << "  -n samples  Number of timings for each case (default 500)\n"
+	     << "  -t threads  Instead, render from this many threads at once, checking\n"
+	     << "              the output against single threaded rendering\n"
+	     << "Synthetic worst case pages are always included.\n";
+}
+
+struct Page
+{
+	string name;
+	Image<byte> text;
+};
+
+vector<Page> load_pages(int argc, char** argv)
+{
+	vector<Page> pages;
+
+	for(int i=0; i < argc; i++)
+	{
+		ifstream in(argv[i]);
+		Image<byte> text(ImageRef(Renderer::w, Renderer::h));
+		in.read(reinterpret_cast<char*>(text.data()), text.size().area());
+
+		if(in.good())
+			pages.push_back({argv[i], text});
+		else
+			cerr << "Error reading from \"" << argv[i] << "\"\n";
+	}
+
+	//Every code, colour and glyph
+	mt19937 rng(0);
+	Image<byte> random(ImageRef(Renderer::w, Renderer::h));
+	for(auto& c: random)
+		c = rng() & 0x7f;
+	pages.push_back({"random", random});
+
+	//Flashing double height on every row, so both phases differ everywhere
+	//and every other row is a bottom half.
+	Image<byte> flash(ImageRef(Renderer::w, Renderer::h));
+	for(int y=0; y < Renderer::h; y++)
+	{
+		flash[y][0] = 13;
+		flash[y][1] = 8;
+		for(int x=2; x < Renderer::w; x++)
+			flash[y][x] = (x%8 == 0) ? 17 + y%7 : 'A' + (x+y)%26;
+	}
+	pages.push_back({"flash_double", flash});
+
+	//Graphics right across every row, which is the longest run for the
+	//sixel operations to shift along.
+	Image<byte> graphics(ImageRef(Renderer::w, Renderer::h));
+	for(int y=0; y < Renderer::h; y++)
+	{
+		graphics[y][0] = 17 + y%7;
+		for(int x=1; x < Renderer::w; x++)
+			graphics[y][x] = 32 | (rng() & 0x5f);
+	}
+	pages.push_back({"graphics", graphics});
+
+	return pages;
+}
+
+//Prints a line of the table, given the time per operation of each sample.
+void report(const string& name, vector<double>& t, double ops_per_s)
+{
+	sort(t.begin(), t.end());
+	double median = t[t.size()/2];
+	double p99 = t[min(t.size()-1, t.size()*99/100)];
+
+	cout << name << "\t" << t.size() << "\t" << fixed << setprecision(1) << median << "\t" << p99 << "\t"
+	     << setprecision(0) << ops_per_s << "\n" << defaultfloat;
+}
+
+//Calls f(batch) samples times, timing each call.
+void run(const string& name, int samples, int batch, const function<void(int)>& f)
+{
+	vector<double> t(samples);
+	double total=0;
+
+	//Warm up the caches and branch predictors
+	f(batch);
+
+	for(auto& s: t)
+	{
+		auto start = chrono::steady_clock::now();
+		f(batch);
+		s = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / batch;
+		total += s * batch;
+	}
+
+	report(name, t, samples * batch / (total * 1e-9));
+}
+
+//Renders every page from n threads at once, all sharing one Renderer for
+//each scale, and checks every result against a single threaded render.
+//The threads also race to build a scaled font, which they must all get
+//the same copy of.
+bool stress(const vector<Page>& pages, int threads, int samples)
+{
+	const Renderer renderers[] = {{1, false}, {2, true}};
+
+	struct Case
+	{
+		const Renderer* ren;
+		const Page* page;
+		bool control, flash_on;
+		vector<byte> reference;
+	};
+
+	vector<Case> cases;
+	for(const auto& r: renderers)
+		for(const auto& p: pages)
+			for(int control=0; control < 2; control++)
+				for(int flash=0; flash < 2; flash++)
+				{
+					Case c{&r, &p, bool(control), bool(flash), vector<byte>(r.size().area() * 3)};
+					r.render(p.text, c.control, c.flash_on, PixelFormat::RGB, c.reference.data(), r.size().x * 3);
+					cases.push_back(move(c));
+				}
+
+	atomic<int> wrong(0);
+	vector<vector<double>> times(threads);
+	vector<const FontSet*> fonts(threads);
+
+	auto start = chrono::steady_clock::now();
+
+	vector<thread> workers;
+	for(int i=0; i < threads; i++)
+		workers.emplace_back([&, i]()
+		{
+			fonts[i] = &FontSet::get(3, true);
+
+			vector<byte> out;
+			for(int s=0; s < samples; s++)
+			{
+				//Each thread goes through the cases in a different order.
+				const Case& c = cases[(s * 7 + i * 13) % cases.size()];
+				out.assign(c.reference.size(), 0);
+
+				auto t = chrono::steady_clock::now();
+				c.ren->render(c.page->text, c.control, c.flash_on, PixelFormat::RGB, out.data(), c.ren->size().x * 3);
+				times[i].push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - t).count());
+
+				if(out != c.reference)
+					wrong++;
+			}
+		});
+
+	for(auto& w: workers)
+		w.join();
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	vector<double> all;
+	for(const auto& t: times)
+		all.insert(all.end(), t.begin(), t.end());
+
+	report("render_threads/" + to_string(threads), all, all.size() / seconds);
+
+	for(const FontSet* f: fonts)
+		if(f != fonts[0])
+			wrong++;
+
+	if(wrong)
+		cerr << "Error: " << wrong << " renders from " << threads << " threads differed from single threaded ones\n";
+	return wrong == 0;
+}
+
+int main(int argc, char** argv)
+{
+	int samples = 500;
+	int threads = 0;
+
+	int c;
+	while((c = getopt(argc, argv, "n:t:h")) != -1)
+	{
+		if(c == 'n')
+			samples = max(1, atoi(optarg));
+		else if(c == 't')
+			threads = max(1, atoi(optarg));
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	vector<Page> pages = load_pages(argc - optind, argv + optind);
+
+	cout << "# blit kernel: " << blit_kernel_name(best_blit_kernel()) << "\n";
+	cout << "name\tsamples\tmedian_ns\tp99_ns\tops_per_s\n";
+
+	if(threads)
+		return !stress(pages, threads, samples);
+
+	//The font tables are built at compile time, so this should cost no
+	//more than an allocation. It's here to catch that changing.
+	run("fontset", samples, 1, [](int)
+	{
+		unique_ptr<FontSet> f(new FontSet);
+	});
+
+	//Scaled fonts are built once per scale when first needed.
+	run("fontset/x4_rounded", samples, 1, [](int)
+	{
+		unique_ptr<FontSet> f(new FontSet(4, true));
+	});
+
+	//Full renders: invalidate first, or the renderer would notice that
+	//nothing changed and draw nothing.
+	Renderer ren;
+	for(const auto& p: pages)
+		for(int control=0; control < 2; control++)
+			for(int flash=0; flash < 2; flash++)
+			{
+				string name = string("render/") + (control ? "codes" : "nocodes") + "/" + (flash ? "flash_on" : "flash_off") + "/" + p.name;
+				run(name, samples, 1, [&](int)
+				{
+					ren.invalidate();
+					ren.render(p.text, control, flash);
+				});
+			}
+
+	//Rendering into a caller's buffer in each pixel format.
+	{
+		const PixelFormat formats[] = {PixelFormat::Index8, PixelFormat::Index4, PixelFormat::RGB, PixelFormat::RGBA};
+		const char* names[] = {"index8", "index4", "rgb", "rgba"};
+		const int bits[] = {8, 4, 24, 32};
+		vector<byte> buffer(ren.size().area() * 4);
+
+		for(int i=0; i < 4; i++)
+			for(const auto& p: pages)
+				run(string("render_into/") + names[i] + "/" + p.name, samples, 1, [&](int)
+				{
+					ren.render(p.text, false, true, formats[i], buffer.data(), ren.size().x * bits[i] / 8);
+				});
+	}
+
+	//Scaled renders should cost the same per pixel as native ones.
+	for(int scale=2; scale <= FontSet::max_scale; scale+=2)
+	{
+		Renderer big(scale, true);
+		for(const auto& p: pages)
+			run("render/x" + to_string(scale) + "_rounded/" + p.name, samples, 1, [&](int)
+			{
+				big.invalidate();
+				big.render(p.text, false, true);
+			});
+	}
+
+	//Flipping phase on a page which is already drawn, which is what the
+	//editor does twice a second.
+	for(const auto& p: pages)
+	{
+		bool flash = false;
+		ren.invalidate();
+		run("render/flash_toggle/" + p.name, samples, 1, [&](int)
+		{
+			flash = !flash;
+			ren.render(p.text, false, flash);
+		});
+	}
+
+	//The edits work on a scratch copy which is reset before each batch,
+	//so that repeated inserts don't leave a blank page behind.
+	const int batch = 64;
+	Image<byte> scratch(ImageRef(Renderer::w, Renderer::h));
+
+	auto edit = [&](const string& op, const Page& p, const vector<ImageRef>& where, const function<void(const ImageRef&)>& f)
+	{
+		if(where.empty())
+			return;
+
+		size_t n=0;
+		run(op + "/" + p.name, samples, batch, [&](int b)
+		{
+			scratch.copy_from(p.text);
+			for(int i=0; i < b; i++, n++)
+				f(where[n % where.size()]);
+		});
+	};
+
+	for(const auto& p: pages)
+	{
+		//Every cell for character edits and every sixel in a graphics
+		//cell for sixel edits.
+		vector<ImageRef> cells, sixels, rows;
+		for(int y=0; y < Renderer::h; y++)
+		{
+			rows.push_back(ImageRef(0, y));
+			for(int x=0; x < Renderer::w; x++)
+			{
+				cells.push_back(ImageRef(x, y));
+				if(p.text[y][x] & 32)
+					for(int s=0; s < 6; s++)
+						sixels.push_back(ImageRef(x*2 + s%2, y*3 + s/2));
+			}
+		}
+
+		shuffle(cells.begin(), cells.end(), mt19937(1));
+		shuffle(sixels.begin(), sixels.end(), mt19937(2));
+
+		edit("insert_row", p, rows, [&](const ImageRef& r){ insert_row(scratch, r.y); });
+		edit("delete_row", p, rows, [&](const ImageRef& r){ delete_row(scratch, r.y); });
+		edit("insert_char", p, cells, [&](const ImageRef& r){ insert_char(scratch, r.x, r.y); });
+		edit("delete_char", p, cells, [&](const ImageRef& r){ delete_char(scratch, r.x, r.y); });
+		edit("insert_sixel", p, sixels, [&](const ImageRef& r){ insert_sixel(scratch, r.x, r.y); });
+		edit("delete_sixel", p, sixels, [&](const ImageRef& r){ delete_sixel(scratch, r.x, r.y); });
+		edit("insert_sixel_column", p, sixels, [&](const ImageRef& r){ SixelPlane s(scratch); s.insert_column(r.x); s.store(scratch); });
+		edit("insert_sixel_row", p, sixels, [&](const ImageRef& r){ SixelPlane s(scratch); s.insert_row(r.y); s.store(scratch); });
+		edit("fill_sixels", p, sixels, [&](const ImageRef& r){ SixelPlane s(scratch); s.fill(r, r + ImageRef(20, 15), Set::Toggle); s.store(scratch); });
+	}
+
+	return 0;
+}
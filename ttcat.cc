@@ -0,0 +1,184 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include <cvd/image.h>
+
+#include "ansi.h"
+#include "render.h"
+#include "archive.h"
+
+using namespace std;
+using namespace CVD;
+
+//Shows pages in a terminal as ANSI truecolour text, for when there's no
+//display to run the editor on. Pages can be piped in one after another
+//(e.g. from ttdecode), in which case each one is drawn over the last.
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " [-f] [-b cols] [-c] page_or_archive ...\n"
+	     << "  -f       Show the flash-off phase\n"
+	     << "  -b cols  Draw the rendered page in half blocks, cols characters wide\n"
+	     << "  -c       Render control codes (with -b)\n"
+	     << "  -        Read raw pages from stdin, drawing each over the last\n";
+}
+
+struct Options
+{
+	bool flash_on=true;
+	bool control=false;
+	int cols=0;
+};
+
+//Each page is built up in one string and written in one go, so that
+//streamed pages don't flicker.
+void show(const Renderer& ren, const BasicImage<byte>& text, const Options& o, string& out)
+{
+	if(o.cols)
+	{
+		static Image<byte> colours(ren.size());
+		ren.render(text, o.control, o.flash_on, PixelFormat::Index8, colours.data(), colours.row_stride());
+		ansi_halfblocks(colours, o.cols, out);
+	}
+	else
+	{
+		PageCells cells;
+		decode_cells(text, cells);
+		ansi_cells(cells, o.flash_on, out);
+	}
+
+	fwrite(out.data(), 1, out.size(), stdout);
+	fflush(stdout);
+}
+
+bool show_file(const Renderer& ren, const string& name, const Options& o, string& out)
+{
+	string file;
+	int page, subpage;
+
+	if(parse_archive_name(name, file, page, subpage))
+	{
+		unique_ptr<PageArchive> a;
+		try
+		{
+			a.reset(new PageArchive(file));
+		}
+		catch(ArchiveError& e)
+		{
+			cerr << e.what() << endl;
+			return false;
+		}
+
+		if(page == -1)
+		{
+			for(size_t i=0; i < a->size(); i++)
+			{
+				out.clear();
+				show(ren, a->page(i), o, out);
+			}
+		}
+		else
+		{
+			long i = a->find(page, max(subpage, 0));
+			if(i == -1)
+			{
+				cerr << "No page " << name << endl;
+				return false;
+			}
+			out.clear();
+			show(ren, a->page(i), o, out);
+		}
+
+		return true;
+	}
+
+	ifstream in(name);
+	Image<byte> text(ImageRef(Renderer::w, Renderer::h));
+	in.read(reinterpret_cast<char*>(text.data()), text.size().area());
+
+	if(!in.good())
+	{
+		cerr << "Error reading from \"" << name << "\": " << strerror(errno) << endl;
+		return false;
+	}
+
+	out.clear();
+	show(ren, text, o, out);
+	return true;
+}
+
+//Pages arrive whole or not at all, so each one is drawn as soon as it's
+//read, from the top left of the screen.
+void stream(const Renderer& ren, const Options& o, string& out)
+{
+	Image<byte> text(ImageRef(Renderer::w, Renderer::h));
+	const size_t n = text.size().area();
+
+	fputs("\x1b[2J", stdout);
+
+	while(true)
+	{
+		size_t have=0;
+		while(have < n)
+		{
+			ssize_t r = read(0, text.data() + have, n - have);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r <= 0)
+				return;
+			have += r;
+		}
+
+		out = "\x1b[H";
+		show(ren, text, o, out);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options o;
+
+	int c;
+	while((c = getopt(argc, argv, "fb:ch")) != -1)
+	{
+		if(c == 'f')
+			o.flash_on = false;
+		else if(c == 'b')
+			o.cols = atoi(optarg);
+		else if(c == 'c')
+			o.control = true;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind == argc || o.cols < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	const Renderer ren;
+	string out;
+	int failed=0;
+
+	for(int i=optind; i < argc; i++)
+	{
+		if(string(argv[i]) == "-")
+			stream(ren, o, out);
+		else if(!show_file(ren, argv[i], o, out))
+			failed++;
+	}
+
+	return failed != 0;
+}
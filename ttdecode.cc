@@ -0,0 +1,152 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "t42.h"
+#include "archive.h"
+
+using namespace std;
+using namespace CVD;
+
+//Decodes a stream of T42 packets into pages as they arrive. Pages go to
+//stdout as raw 1000 byte pages, or to a directory, or to an archive.
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " [-o dir | -a archive.ttxa] [-q] [file.t42]\n"
+	     << "  -o dir     Write each page to dir/PPP_SSSS.txt\n"
+	     << "  -a file    Write the pages to an archive\n"
+	     << "  -q         Don't print statistics\n"
+	     << "Packets are read from stdin if no file is given. With no -o or -a,\n"
+	     << "pages are written to stdout as they are completed.\n";
+}
+
+int main(int argc, char** argv)
+{
+	string out_dir, archive;
+	bool quiet=false;
+
+	int c;
+	while((c = getopt(argc, argv, "o:a:qh")) != -1)
+	{
+		if(c == 'o')
+			out_dir = optarg;
+		else if(c == 'a')
+			archive = optarg;
+		else if(c == 'q')
+			quiet = true;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(argc - optind > 1 || (!out_dir.empty() && !archive.empty()))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	FILE* in = stdin;
+	if(optind < argc)
+	{
+		in = fopen(argv[optind], "rb");
+		if(in == nullptr)
+		{
+			cerr << "Error opening \"" << argv[optind] << "\": " << strerror(errno) << endl;
+			return 1;
+		}
+	}
+
+	unique_ptr<ArchiveWriter> writer;
+	int failed=0;
+
+	try
+	{
+		if(!archive.empty())
+			writer.reset(new ArchiveWriter(archive));
+
+		T42Decoder decoder([&](const T42Decoder::Page& p)
+		{
+			if(writer)
+				writer->add(p.number, p.subcode, "", p.text);
+			else if(!out_dir.empty())
+			{
+				ostringstream name;
+				name << out_dir << "/" << hex << setfill('0') << setw(3) << p.number << "_" << setw(4) << p.subcode << ".txt";
+				ofstream out(name.str());
+				out.write(reinterpret_cast<const char*>(p.text.data()), p.text.size().area());
+				if(!out.good())
+				{
+					cerr << "Error writing to \"" << name.str() << "\": " << strerror(errno) << endl;
+					failed++;
+				}
+			}
+			else
+			{
+				cout.write(reinterpret_cast<const char*>(p.text.data()), p.text.size().area());
+				cout.flush();
+			}
+		});
+
+		auto start = chrono::steady_clock::now();
+
+		//Read lots of packets at a time, but don't wait for a full buffer
+		//before decoding, so that pages come out as they arrive.
+		const int n = T42Decoder::packet_bytes;
+		vector<byte> buffer(n * 1024);
+		size_t have=0;
+
+		while(true)
+		{
+			ssize_t r = read(fileno(in), buffer.data() + have, buffer.size() - have);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r <= 0)
+				break;
+			have += r;
+
+			size_t used=0;
+			for(; used + n <= have; used += n)
+				decoder.decode(buffer.data() + used);
+
+			copy(buffer.begin() + used, buffer.begin() + have, buffer.begin());
+			have -= used;
+		}
+
+		decoder.flush();
+
+		if(writer)
+			writer->finish();
+
+		if(!quiet)
+		{
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			const T42Decoder::Stats& s = decoder.stats();
+			cerr << "Decoded " << s.packets << " packets into " << s.pages << " pages in " << setprecision(3) << seconds << "s ("
+			     << s.packets / seconds << " packets/s)\n"
+			     << "Hamming bytes: " << s.hamming_corrected << " corrected, " << s.hamming_errors << " uncorrectable\n"
+			     << "Parity errors: " << s.parity_errors << "\n";
+			if(have)
+				cerr << "Ignored " << have << " bytes of incomplete packet at the end\n";
+		}
+	}
+	catch(ArchiveError& e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return failed != 0;
+}
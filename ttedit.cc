@@ -0,0 +1,172 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include <cvd/image.h>
+
+#include "edit_session.h"
+#include "history.h"
+
+using namespace std;
+using namespace CVD;
+
+//Replays editing sessions recorded by the editor (editor -r log), or
+//scripts of commands, without a display. This is for checking that
+//edits still do what they did, and for making pages from scripts.
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " [-t] [-i page] [-o page] [-l log] [-d] [-n times] log_or_script\n"
+	     << "  -t       The input is a script of commands as text\n"
+	     << "  -i page  Start from this page rather than a blank one\n"
+	     << "  -o page  Write the page at the end to a file\n"
+	     << "  -l log   Write the commands to a log (e.g. to compile a script)\n"
+	     << "  -d       Print the commands as text instead of running them\n"
+	     << "  -n n     Replay n times and print the speed\n";
+}
+
+bool read_file(const string& name, vector<byte>& data)
+{
+	ifstream in(name, ios::binary);
+	data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	if(in.bad() || !in.is_open())
+	{
+		cerr << "Error reading from \"" << name << "\": " << strerror(errno) << endl;
+		return false;
+	}
+	return true;
+}
+
+bool write_file(const string& name, const byte* data, size_t size, const char* header=nullptr, size_t header_size=0)
+{
+	ofstream out(name, ios::binary);
+	out.write(header, header_size);
+	out.write(reinterpret_cast<const char*>(data), size);
+	if(!out.good())
+	{
+		cerr << "Error writing to \"" << name << "\": " << strerror(errno) << endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bool script=false, dump=false;
+	string in_page, out_page, out_log;
+	long repeats=1;
+
+	int c;
+	while((c = getopt(argc, argv, "ti:o:l:dn:h")) != -1)
+	{
+		if(c == 't')
+			script = true;
+		else if(c == 'i')
+			in_page = optarg;
+		else if(c == 'o')
+			out_page = optarg;
+		else if(c == 'l')
+			out_log = optarg;
+		else if(c == 'd')
+			dump = true;
+		else if(c == 'n')
+			repeats = atol(optarg);
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(argc - optind != 1 || repeats < 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	vector<byte> data, commands;
+	if(!read_file(argv[optind], data))
+		return 1;
+
+	try
+	{
+		if(script)
+		{
+			istringstream s(string(data.begin(), data.end()));
+			compile_script(s, commands);
+		}
+		else
+		{
+			const size_t n = sizeof(command_log_magic);
+			if(data.size() < n || !equal(command_log_magic, command_log_magic + n, data.begin()))
+			{
+				cerr << "\"" << argv[optind] << "\" isn't a command log\n";
+				return 1;
+			}
+			commands.assign(data.begin() + n, data.end());
+		}
+
+		if(!out_log.empty() && !write_file(out_log, commands.data(), commands.size(), command_log_magic, sizeof(command_log_magic)))
+			return 1;
+
+		if(dump)
+		{
+			dump_log(commands.data(), commands.size(), cout);
+			return 0;
+		}
+
+		Image<byte> start(ImageRef(40, 25), ' ');
+		if(!in_page.empty())
+		{
+			ifstream in(in_page);
+			in.read(reinterpret_cast<char*>(start.data()), start.size().area());
+			if(!in.good())
+			{
+				cerr << "Error reading from \"" << in_page << "\": " << strerror(errno) << endl;
+				return 1;
+			}
+		}
+
+		//Each replay starts afresh, with its own history for undo.
+		const bool undo = log_uses_history(commands.data(), commands.size());
+		Image<byte> result;
+		size_t n_commands=0;
+		auto begin = chrono::steady_clock::now();
+
+		for(long i=0; i < repeats; i++)
+		{
+			History history;
+			EditSession session(undo ? &history : nullptr);
+			session.set_page(start);
+			n_commands = session.replay(commands.data(), commands.size());
+			if(i == repeats-1)
+				result = session.page();
+		}
+
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+		if(repeats > 1)
+			cerr << "Replayed " << n_commands << " commands " << repeats << " times in " << setprecision(3) << seconds << "s ("
+			     << n_commands * repeats / seconds << " commands/s)\n";
+
+		if(!out_page.empty() && !write_file(out_page, result.data(), result.size().area()))
+			return 1;
+	}
+	catch(CommandError& e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include <cvd/image_io.h>
+
+#include "mosaic.h"
+#include "render.h"
+
+using namespace std;
+using namespace CVD;
+
+//Converts a picture into a page of block graphics (see mosaic.h).
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " [-j threads] [-o page] picture\n"
+	     << "  -j n    Number of threads (default: all cores)\n"
+	     << "  -o file Write the page to file rather than stdout\n"
+	     << "Pictures can be anything libCVD can load, such as PPM or PNG.\n";
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int threads=0;
+	string out_name;
+
+	int c;
+	while((c = getopt(argc, argv, "j:o:h")) != -1)
+	{
+		if(c == 'j')
+			threads = atoi(optarg);
+		else if(c == 'o')
+			out_name = optarg;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(argc - optind != 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	Image<Rgb<byte>> picture;
+	try
+	{
+		img_load(picture, string(argv[optind]));
+	}
+	catch(Exceptions::All& e)
+	{
+		cerr << "Error loading \"" << argv[optind] << "\": " << e.what() << endl;
+		return 1;
+	}
+
+	auto start = chrono::steady_clock::now();
+
+	Image<byte> page(ImageRef(Renderer::w, Renderer::h));
+	picture_to_mosaic(picture, page, threads);
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cerr << "Converted in " << setprecision(3) << seconds << "s\n";
+
+	ofstream file;
+	if(!out_name.empty())
+		file.open(out_name);
+	ostream& out = out_name.empty() ? cout : file;
+
+	out.write(reinterpret_cast<const char*>(page.data()), page.size().area());
+	out.flush();
+
+	if(!out.good())
+	{
+		cerr << "Error writing to \"" << (out_name.empty() ? "stdout" : out_name) << "\": " << strerror(errno) << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,394 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unordered_set>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cvd/image_io.h>
+
+#include "render.h"
+#include "font.h"
+#include "work_queue.h"
+#include "archive.h"
+
+using namespace std;
+using namespace CVD;
+
+//Headless batch renderer. Renders teletext pages to images on all
+//cores without going anywhere near FLTK.
+//
+//Pages in archives are rendered straight out of the mapped file. File
+//names are fed to the workers through a bounded queue, and
+//directories are walked lazily, so the only memory which grows with
+//the number of pages is the set of image names already handed out.
+
+struct Options
+{
+	string out_dir=".";
+	ImageType::ImageType type=ImageType::PNM;
+	string extension=".ppm";
+	bool control=false;
+	bool flash_on=true;
+	int scale=1;
+	bool rounding=false;
+	bool indexed=false;
+	unsigned int threads=0;
+};
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " [-j threads] [-o outdir] [-p] [-c] [-f] [-s scale] [-r] [-i] page_dir_or_archive ...\n"
+	     << "  -j n   Number of render threads (default: all cores)\n"
+	     << "  -o dir Directory to write images to (default: .)\n"
+	     << "  -p     Write PNG instead of PPM\n"
+	     << "  -c     Render control codes\n"
+	     << "  -f     Render the flash-off phase\n"
+	     << "  -s n   Render at n times the size (1 to 4)\n"
+	     << "  -r     Round the diagonals of scaled text\n"
+	     << "  -i     Write colour numbers (0-7) as greyscale instead of RGB\n"
+	     << "  -      Read page file names from stdin, one per line\n";
+}
+
+bool is_directory(const string& name)
+{
+	struct stat s;
+	return stat(name.c_str(), &s) == 0 && S_ISDIR(s.st_mode);
+}
+
+//A page to render: either a file, or a page in an archive.
+struct Job
+{
+	string name;
+	shared_ptr<const PageArchive> archive;
+	size_t index=0;
+	string out_name;
+};
+
+//Finds the pages to render and decides where their images go. Images of
+//pages found by walking a directory go in the same subdirectory of the
+//output directory, so that pages with the same name in different
+//directories don't overwrite each other. Anything else which would
+//write an image twice is reported and skipped, which also means no two
+//threads ever write the same file.
+class Inputs
+{
+	const Options& o;
+	WorkQueue<Job>& q;
+	unordered_set<string> outputs;
+
+	public:
+	long clashes=0;
+
+	Inputs(const Options& o_, WorkQueue<Job>& q_)
+	:o(o_),q(q_)
+	{}
+
+	//dir is where under the output directory images go: empty, or
+	//ending in /.
+	void add(const string& name, const string& dir="")
+	{
+		string file;
+		int page, subpage;
+
+		if(parse_archive_name(name, file, page, subpage))
+		{
+			shared_ptr<const PageArchive> a;
+			try
+			{
+				a = make_shared<const PageArchive>(file);
+			}
+			catch(ArchiveError& e)
+			{
+				cerr << e.what() << endl;
+				return;
+			}
+
+			if(page == -1)
+			{
+				for(size_t i=0; i < a->size(); i++)
+					push(Job{file, a, i, ""}, dir);
+			}
+			else
+			{
+				long i = a->find(page, max(subpage, 0));
+				if(i == -1)
+					cerr << "No page " << name << endl;
+				else
+					push(Job{file, a, size_t(i), ""}, dir);
+			}
+		}
+		else if(is_directory(name))
+			walk(name, dir);
+		else
+			push(Job{name, nullptr, 0, ""}, dir);
+	}
+
+	private:
+
+	//Feed files from a directory into the queue without ever holding
+	//the whole listing.
+	void walk(const string& in_dir, const string& dir)
+	{
+		DIR* d = opendir(in_dir.c_str());
+		if(d == nullptr)
+		{
+			cerr << "Error opening directory \"" << in_dir << "\": " << strerror(errno) << endl;
+			return;
+		}
+
+		while(dirent* e = readdir(d))
+		{
+			if(e->d_name[0] == '.')
+				continue;
+
+			const string name = in_dir + "/" + e->d_name;
+			if(is_directory(name))
+			{
+				const string sub = dir + e->d_name + "/";
+				const string out = o.out_dir + "/" + sub;
+				if(mkdir(out.c_str(), 0777) != 0 && errno != EEXIST)
+					cerr << "Error creating directory \"" << out << "\": " << strerror(errno) << endl;
+				else
+					walk(name, sub);
+			}
+			else
+				add(name, dir);
+		}
+
+		closedir(d);
+	}
+
+	void push(Job j, const string& dir)
+	{
+		j.out_name = output_name(j, dir);
+		if(!outputs.insert(j.out_name).second)
+		{
+			cerr << "Not rendering \"" << (j.archive ? archive_name(j.name, j.archive->entry(j.index).page, j.archive->entry(j.index).subpage) : j.name)
+			     << "\": another page is already being written to \"" << j.out_name << "\"" << endl;
+			clashes++;
+			return;
+		}
+
+		q.push(move(j));
+	}
+
+	//Pages from archives are named after the archive, page and subpage.
+	string output_name(const Job& j, const string& dir) const
+	{
+		string base = j.name.substr(j.name.find_last_of('/') + 1);
+		size_t dot = base.find_last_of('.');
+		if(dot != string::npos && dot != 0)
+			base = base.substr(0, dot);
+
+		if(j.archive)
+		{
+			ostringstream s;
+			const PageArchive::Entry& e = j.archive->entry(j.index);
+			s << "_" << hex << e.page << "_" << e.subpage;
+			base += s.str();
+		}
+
+		return o.out_dir + "/" + dir + base + o.extension;
+	}
+};
+
+//PPM and PGM are just a header followed by the pixels, so the page is
+//rendered straight into the output buffer, which each thread reuses.
+bool save_pnm(const Renderer& ren, const BasicImage<byte>& text, const string& out_name, const Options& o)
+{
+	const ImageRef size = ren.size();
+	const size_t stride = size.x * (o.indexed ? 1 : 3);
+
+	ostringstream h;
+	if(o.indexed)
+		h << "P5\n" << size.x << " " << size.y << "\n7\n";
+	else
+		h << "P6\n" << size.x << " " << size.y << "\n255\n";
+	const string header = h.str();
+
+	thread_local vector<byte> buffer;
+	buffer.resize(header.size() + stride * size.y);
+	copy(header.begin(), header.end(), buffer.begin());
+	ren.render(text, o.control, o.flash_on, o.indexed ? PixelFormat::Index8 : PixelFormat::RGB, buffer.data() + header.size(), stride);
+
+	ofstream out(out_name);
+	out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+	if(!out.good())
+	{
+		cerr << "Error writing to \"" << out_name << "\": " << strerror(errno) << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool save_page(const Renderer& ren, const BasicImage<byte>& text, const string& out_name, const Options& o)
+{
+	if(o.type == ImageType::PNM)
+		return save_pnm(ren, text, out_name, o);
+
+	ofstream out(out_name);
+	try
+	{
+		if(o.indexed)
+		{
+			Image<byte> index(ren.size());
+			ren.render(text, o.control, o.flash_on, PixelFormat::Index8, index.data(), index.row_stride());
+			img_save(index, out, o.type);
+		}
+		else
+		{
+			Image<Rgb<byte>> image(ren.size());
+			ren.render(text, o.control, o.flash_on, PixelFormat::RGB, image.data(), image.row_stride() * sizeof(Rgb<byte>));
+			img_save(image, out, o.type);
+		}
+	}
+	catch(Exceptions::All& e)
+	{
+		cerr << "Error saving \"" << out_name << "\": " << e.what() << endl;
+		return false;
+	}
+
+	if(!out.good())
+	{
+		cerr << "Error writing to \"" << out_name << "\": " << strerror(errno) << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool render_one(const Renderer& ren, const Job& j, const Options& o)
+{
+	if(j.archive)
+		return save_page(ren, j.archive->page(j.index), j.out_name, o);
+
+	ifstream in(j.name);
+
+	Image<byte> text(ImageRef(ren.w, ren.h));
+	in.read(reinterpret_cast<char*>(text.data()), text.size().area());
+
+	if(!in.good())
+	{
+		cerr << "Error reading from \"" << j.name << "\": " << strerror(errno) << endl;
+		return false;
+	}
+
+	return save_page(ren, text, j.out_name, o);
+}
+
+int main(int argc, char** argv)
+{
+	Options o;
+
+	int c;
+	while((c = getopt(argc, argv, "j:o:pcfs:rih")) != -1)
+	{
+		if(c == 'j')
+			o.threads = atoi(optarg);
+		else if(c == 'o')
+			o.out_dir = optarg;
+		else if(c == 'p')
+		{
+			o.type = ImageType::PNG;
+			o.extension = ".png";
+		}
+		else if(c == 'c')
+			o.control = true;
+		else if(c == 'f')
+			o.flash_on = false;
+		else if(c == 's')
+			o.scale = atoi(optarg);
+		else if(c == 'r')
+			o.rounding = true;
+		else if(c == 'i')
+		{
+			o.indexed = true;
+			if(o.type == ImageType::PNM)
+				o.extension = ".pgm";
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind == argc || o.scale < 1 || o.scale > FontSet::max_scale)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(o.threads == 0)
+		o.threads = max(1u, thread::hardware_concurrency());
+
+	WorkQueue<Job> queue(4 * o.threads);
+	atomic<long> rendered(0), failed(0);
+
+	auto start = chrono::steady_clock::now();
+
+	//Rendering into a buffer doesn't change the renderer, so all the
+	//threads share one.
+	const Renderer ren(o.scale, o.rounding);
+
+	vector<thread> workers;
+	for(unsigned int i=0; i < o.threads; i++)
+		workers.emplace_back([&]()
+		{
+			Job job;
+			while(queue.pop(job))
+			{
+				if(render_one(ren, job, o))
+					rendered++;
+				else
+					failed++;
+			}
+		});
+
+	Inputs inputs(o, queue);
+	for(int i=optind; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if(arg == "-")
+		{
+			string name;
+			while(getline(cin, name))
+				if(!name.empty())
+					inputs.add(name);
+		}
+		else
+			inputs.add(arg);
+	}
+
+	queue.close();
+	for(auto& t: workers)
+		t.join();
+
+	failed += inputs.clashes;
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	cerr << "Rendered " << rendered << " pages in " << setprecision(3) << seconds << "s ("
+	     << rendered / seconds << " pages/s, " << o.threads << " threads)";
+	if(failed)
+		cerr << ", " << failed << " failed";
+	cerr << endl;
+
+	return failed != 0;
+}
@@ -0,0 +1,330 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include <cvd/image.h>
+
+#include "render.h"
+#include "font.h"
+#include "work_queue.h"
+#include "archive.h"
+
+using namespace std;
+using namespace CVD;
+
+//Renders pages as video on stdout, for piping into an encoder. Flashing
+//text blinks every half second, like in the editor, and several pages
+//are shown in turn as a carousel, like subpages on air.
+//
+//Frames are rendered on worker threads. A run of identical frames (the
+//same page, in the same flash phase if it has any flashing) is only
+//rendered once, and its bytes are written out repeatedly.
+
+void usage(const char* name)
+{
+	cerr << "Usage: " << name << " [-j threads] [-r fps] [-d seconds] [-t seconds] [-s scale] [-c] [-R] page_or_archive ... > out.y4m\n"
+	     << "  -j n   Number of render threads (default: all cores)\n"
+	     << "  -r n   Frames per second (default: 25)\n"
+	     << "  -d n   Seconds to show each page (default: 8)\n"
+	     << "  -t n   Length in seconds (default: once round all the pages)\n"
+	     << "  -s n   Render at n times the size (1 to 4)\n"
+	     << "  -c     Render control codes\n"
+	     << "  -R     Write raw RGB frames instead of Y4M\n"
+	     << "An archive:page without a subpage shows all of its subpages.\n";
+}
+
+struct Options
+{
+	unsigned int threads=0;
+	int fps=25;
+	double dwell=8;
+	double length=0;
+	int scale=1;
+	bool control=false;
+	bool raw=false;
+};
+
+//Same as the editor.
+static const double blink_time=.5;
+
+void add_input(const string& name, vector<Image<byte>>& pages)
+{
+	string file;
+	int page, subpage;
+
+	auto add = [&](const BasicImage<byte>& text)
+	{
+		pages.emplace_back(text.size());
+		pages.back().copy_from(text);
+	};
+
+	if(parse_archive_name(name, file, page, subpage))
+	{
+		PageArchive a(file);
+
+		for(size_t i=0; i < a.size(); i++)
+		{
+			const PageArchive::Entry& e = a.entry(i);
+			if((page == -1 || e.page == page) && (subpage == -1 || e.subpage == subpage))
+				add(a.page(i));
+		}
+	}
+	else
+	{
+		ifstream in(name);
+		Image<byte> text(ImageRef(Renderer::w, Renderer::h));
+		in.read(reinterpret_cast<char*>(text.data()), text.size().area());
+
+		if(!in.good())
+			throw ArchiveError("Error reading from \"" + name + "\": " + strerror(errno));
+
+		pages.push_back(text);
+	}
+}
+
+//Frames in BT.601 YUV 4:2:0. There are only 8 colours, so the pages are
+//rendered as colour numbers and converted with a table.
+class Y4M
+{
+	ImageRef size;
+	byte y[8], u[8], v[8];
+
+	public:
+
+	Y4M(ImageRef s)
+	:size(s)
+	{
+		for(int i=0; i < 8; i++)
+		{
+			Rgb<byte> c = Renderer::colour(i);
+			y[i] = lrint( 16 + ( 65.738*c.red + 129.057*c.green +  25.064*c.blue) / 256);
+			u[i] = lrint(128 + (-37.945*c.red -  74.494*c.green + 112.439*c.blue) / 256);
+			v[i] = lrint(128 + (112.439*c.red -  94.154*c.green -  18.285*c.blue) / 256);
+		}
+	}
+
+	string header(int fps) const
+	{
+		ostringstream h;
+		h << "YUV4MPEG2 W" << size.x << " H" << size.y << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+		return h.str();
+	}
+
+	void frame(const Renderer& ren, const BasicImage<byte>& text, bool control, bool flash_on, vector<byte>& out) const
+	{
+		static const char tag[] = "FRAME\n";
+		const int w = size.x, h = size.y;
+		const int cw = w/2, ch = h/2;
+
+		thread_local vector<byte> index;
+		index.resize(w * h);
+		ren.render(text, control, flash_on, PixelFormat::Index8, index.data(), w);
+
+		const int n_tag = sizeof(tag)-1;
+		out.resize(n_tag + w*h + 2*cw*ch);
+		copy(tag, tag + n_tag, out.begin());
+		byte* o = out.data() + n_tag;
+		byte* uo = o + w*h;
+		byte* vo = uo + cw*ch;
+
+		for(int i=0; i < w*h; i++)
+			o[i] = y[index[i]];
+
+		for(int r=0; r < ch; r++)
+			for(int c=0; c < cw; c++)
+			{
+				const byte* p = &index[2*r*w + 2*c];
+				int a=p[0], b=p[1], d=p[w], e=p[w+1];
+				uo[r*cw + c] = (u[a] + u[b] + u[d] + u[e] + 2) / 4;
+				vo[r*cw + c] = (v[a] + v[b] + v[d] + v[e] + 2) / 4;
+			}
+	}
+};
+
+//A run of identical frames.
+struct Run
+{
+	size_t page;
+	bool flash_on;
+	long frames;
+};
+
+struct Frame
+{
+	vector<byte> bytes;
+	long repeats=0;
+};
+
+int main(int argc, char** argv)
+{
+	Options o;
+
+	int c;
+	while((c = getopt(argc, argv, "j:r:d:t:s:cRh")) != -1)
+	{
+		if(c == 'j')
+			o.threads = atoi(optarg);
+		else if(c == 'r')
+			o.fps = atoi(optarg);
+		else if(c == 'd')
+			o.dwell = atof(optarg);
+		else if(c == 't')
+			o.length = atof(optarg);
+		else if(c == 's')
+			o.scale = atoi(optarg);
+		else if(c == 'c')
+			o.control = true;
+		else if(c == 'R')
+			o.raw = true;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind == argc || o.fps < 1 || o.dwell <= 0 || o.length < 0 || o.scale < 1 || o.scale > FontSet::max_scale)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(isatty(1))
+	{
+		cerr << "Not writing video to a terminal.\n";
+		return 1;
+	}
+
+	if(o.threads == 0)
+		o.threads = max(1u, thread::hardware_concurrency());
+
+	vector<Image<byte>> pages;
+	vector<bool> flashes;
+	try
+	{
+		for(int i=optind; i < argc; i++)
+			add_input(argv[i], pages);
+	}
+	catch(ArchiveError& e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	if(pages.empty())
+	{
+		cerr << "No pages.\n";
+		return 1;
+	}
+
+	for(const auto& p: pages)
+	{
+		PageCells cells;
+		decode_cells(p, cells);
+		bool f=false;
+		for(int y=0; y < PageCells::h; y++)
+			f |= cells.row_flashes(y);
+		flashes.push_back(f);
+	}
+
+	//Work out which page and phase each frame shows, and merge runs of
+	//identical frames.
+	if(o.length == 0)
+		o.length = o.dwell * pages.size();
+
+	const long n_frames = lrint(o.length * o.fps);
+	vector<Run> runs;
+	for(long i=0; i < n_frames; i++)
+	{
+		double t = double(i) / o.fps;
+		size_t page = size_t(t / o.dwell) % pages.size();
+		bool flash_on = !flashes[page] || long(t / blink_time) % 2 == 0;
+
+		if(!runs.empty() && runs.back().page == page && runs.back().flash_on == flash_on)
+			runs.back().frames++;
+		else
+			runs.push_back(Run{page, flash_on, 1});
+	}
+
+	const Renderer ren(o.scale);
+	const Y4M y4m(ren.size());
+	const size_t rgb_bytes = ren.size().area() * 3;
+
+	string header = o.raw ? "" : y4m.header(o.fps);
+	fwrite(header.data(), 1, header.size(), stdout);
+
+	WorkQueue<size_t> jobs(4 * o.threads);
+	ReorderQueue<Frame> done(4 * o.threads);
+
+	vector<thread> workers;
+	for(unsigned int i=0; i < o.threads; i++)
+		workers.emplace_back([&]()
+		{
+			size_t n;
+			while(jobs.pop(n))
+			{
+				const Run& r = runs[n];
+				Frame f;
+				f.repeats = r.frames;
+
+				if(o.raw)
+				{
+					f.bytes.resize(rgb_bytes);
+					ren.render(pages[r.page], o.control, r.flash_on, PixelFormat::RGB, f.bytes.data(), ren.size().x * 3);
+				}
+				else
+					y4m.frame(ren, pages[r.page], o.control, r.flash_on, f.bytes);
+
+				done.push(n, move(f));
+			}
+		});
+
+	thread feeder([&]()
+	{
+		for(size_t i=0; i < runs.size(); i++)
+			jobs.push(i);
+		jobs.close();
+	});
+
+	auto start = chrono::steady_clock::now();
+	bool ok=true;
+
+	//The output has to be drained even after a write error, or the
+	//workers will block.
+	for(size_t i=0; i < runs.size(); i++)
+	{
+		Frame f;
+		done.pop(f);
+		for(long k=0; k < f.repeats && ok; k++)
+			ok = fwrite(f.bytes.data(), 1, f.bytes.size(), stdout) == f.bytes.size();
+	}
+
+	feeder.join();
+	for(auto& t: workers)
+		t.join();
+
+	if(!ok || fflush(stdout) != 0)
+	{
+		cerr << "Error writing video: " << strerror(errno) << endl;
+		return 1;
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cerr << "Wrote " << n_frames << " frames (" << runs.size() << " rendered) in " << setprecision(3) << seconds << "s ("
+	     << n_frames / seconds / o.fps << "x real time)\n";
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef WORK_QUEUE_H_Ql3kzv7XbN2pRw
+#define WORK_QUEUE_H_Ql3kzv7XbN2pRw
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <map>
+
+//A bounded multi producer, multi consumer queue. Producers block when
+//the queue is full, so the amount of work in flight (and therefore the
+//memory used) stays fixed no matter how much input there is.
+template<class T>
+class WorkQueue
+{
+	std::deque<T> items;
+	std::mutex m;
+	std::condition_variable not_full, not_empty;
+	size_t capacity;
+	bool closed=false;
+
+	public:
+
+	explicit WorkQueue(size_t cap)
+	:capacity(cap)
+	{}
+
+	//Returns false if the queue has been closed.
+	bool push(T t)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		not_full.wait(lock, [&]{ return closed || items.size() < capacity;});
+
+		if(closed)
+			return false;
+
+		items.push_back(std::move(t));
+		not_empty.notify_one();
+		return true;
+	}
+
+	//Returns false once the queue is closed and drained.
+	bool pop(T& t)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		not_empty.wait(lock, [&]{ return closed || !items.empty();});
+
+		if(items.empty())
+			return false;
+
+		t = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	//No more items will be pushed. Consumers finish off what is left.
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(m);
+		closed=true;
+		not_full.notify_all();
+		not_empty.notify_all();
+	}
+};
+
+//Puts results back in order when they are finished out of order. Item
+//n can only be pushed once item n-capacity has been popped, so the
+//number of finished items waiting for a slow one is bounded.
+template<class T>
+class ReorderQueue
+{
+	std::map<size_t, T> items;
+	std::mutex m;
+	std::condition_variable not_full, ready;
+	size_t capacity;
+	size_t next=0;
+
+	public:
+
+	explicit ReorderQueue(size_t cap)
+	:capacity(cap)
+	{}
+
+	void push(size_t n, T t)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		not_full.wait(lock, [&]{ return n < next + capacity;});
+
+		items.emplace(n, std::move(t));
+		if(n == next)
+			ready.notify_one();
+	}
+
+	//Waits for the next item in order.
+	void pop(T& t)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		ready.wait(lock, [&]{ return !items.empty() && items.begin()->first == next;});
+
+		t = std::move(items.begin()->second);
+		items.erase(items.begin());
+		next++;
+		not_full.notify_all();
+	}
+};
+
+#endif